@@ -0,0 +1,279 @@
+/** \file
+ * Microbenchmarks for library hot paths, not linked into the library.
+ *
+ * Every benchmark runs a single library call between starting and stopping
+ * timer 1, which counts every second PCLK cycle. The cost of starting and
+ * stopping the timer is measured first and deducted from the results.
+ * Only the benchmarked interrupt is enabled, so no other ISR can distort
+ * the results.
+ *
+ * The results are stored in the bench structure at a fixed location at
+ * the end of the XRAM, so the uVision/bench.ini simulator script can read
+ * them from SDCC and C51 builds alike. C51 reserves the absolute location
+ * itself, for SDCC "make bench" limits the linker's XRAM to BENCHXRAM,
+ * which ends at BENCH_RESULTS. Because SDCC stores words in little endian
+ * and C51 in big endian byte order, the compiler is recorded as well. The
+ * script appends the results to a log, which is turned into a comparison
+ * table by scripts/bench.awk.
+ *
+ * The benchmarks live outside of src/, so their ISR registrations and
+ * main() do not end up in the shared ISR configuration or the builds of
+ * the library users. "make bench" generates a separate configuration.
+ *
+ * @author kami
+ */
+
+#include <Infineon/XC878.h>
+
+#include "config.h"
+
+#include "hsk_boot/hsk_boot.h"
+#include "hsk_can/hsk_can.h"
+#include "hsk_ex/hsk_ex.h"
+#include "hsk_filter/hsk_filter.h"
+#include "hsk_pwc/hsk_pwc.h"
+
+/**
+ * The XRAM address of the bench structure.
+ */
+#define BENCH_RESULTS   0xFB80
+
+/**
+ * The value of bench.done once all benchmarks are complete.
+ */
+#define BENCH_DONE      0xA5
+
+/**
+ * IRCON0 Interrupt Flag for External Interrupt 2 bit.
+ */
+#define BIT_EXINT2      2
+
+/**
+ * Built with SDCC.
+ */
+#define BENCH_SDCC      1
+
+/**
+ * Built with C51.
+ */
+#define BENCH_C51       2
+
+/**
+ * \defgroup BENCH Benchmarks
+ *
+ * The indices of the benchmark results, the uVision/bench.ini script
+ * names them in the same order.
+ *
+ * @{
+ */
+
+/**
+ * hsk_can_data_getSignal() of a 16 bit Motorola signal.
+ */
+#define BENCH_GETSIGNAL_MOTOROLA    0
+
+/**
+ * hsk_can_data_getSignal() of a signed 12 bit Intel signal.
+ */
+#define BENCH_GETSIGNAL_INTEL       1
+
+/**
+ * hsk_can_msg_getData() of an 8 byte message.
+ */
+#define BENCH_MSG_GETDATA           2
+
+/**
+ * The update function generated by FILTER_FACTORY() with 8 values.
+ */
+#define BENCH_FILTER_UPDATE         3
+
+/**
+ * hsk_pwc_channel_getValue() in µs.
+ */
+#define BENCH_PWC_GETVALUE          4
+
+/**
+ * Entering and leaving the shared ISR 8 with a registered EXINT2 callback.
+ */
+#define BENCH_ISR8_EXINT2           5
+
+/**
+ * The number of benchmarks.
+ */
+#define BENCH_COUNT                 6
+
+/**
+ * @}
+ */
+
+/**
+ * The benchmark results.
+ */
+struct bench_results {
+	/**
+	 * Set to BENCH_DONE when all benchmarks are complete.
+	 */
+	ubyte done;
+
+	/**
+	 * The compiler, BENCH_SDCC or BENCH_C51.
+	 */
+	ubyte compiler;
+
+	/**
+	 * The timer counts of an empty measurement.
+	 */
+	uword overhead;
+
+	/**
+	 * The timer counts of every benchmark, without the overhead,
+	 * 0xffff if the timer overflowed.
+	 */
+	uword counts[BENCH_COUNT];
+};
+
+/** \var bench
+ * The benchmark results at BENCH_RESULTS.
+ */
+#ifdef SDCC
+volatile __xdata __at(BENCH_RESULTS) struct bench_results bench;
+#else
+volatile struct bench_results xdata bench _at_ BENCH_RESULTS;
+#endif
+
+/**
+ * Starts a measurement.
+ */
+#define BENCH_START() { \
+	TR1 = 0; \
+	TF1 = 0; \
+	TH1 = 0; \
+	TL1 = 0; \
+	TR1 = 1; \
+}
+
+/**
+ * Stops a measurement and stores the timer counts.
+ *
+ * @param counts
+ *	The variable to store the timer counts in
+ */
+#define BENCH_STOP(counts) { \
+	TR1 = 0; \
+	counts = TF1 ? 0xffff : (uword)TH1 << 8 | TL1; \
+}
+
+/**
+ * Stores the result of a benchmark.
+ *
+ * @param index
+ *	The benchmark, one of \ref BENCH
+ * @param counts
+ *	The measured timer counts
+ */
+#define BENCH_STORE(index, counts) { \
+	bench.counts[index] = counts == 0xffff ? 0xffff : counts - bench.overhead; \
+}
+
+FILTER_FACTORY(filter, uword, ulong, ubyte, 8)
+
+/**
+ * Set by the EXINT2 callback.
+ */
+volatile bool exint2;
+
+void main(void);
+
+/**
+ * The EXINT2 callback, acknowledges the interrupt.
+ */
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+void bench_exint2(void) using 1 {
+	IRCON0 &= ~(1 << BIT_EXINT2);
+	exint2 = 1;
+}
+#pragma restore
+
+/**
+ * Sets up the modules and runs all benchmarks.
+ */
+void main(void) {
+	hsk_can_msg msg;
+	ubyte xdata data[8] = {0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0};
+	ubyte i;
+	uword counts;
+
+	bench.done = 0;
+#ifdef SDCC
+	bench.compiler = BENCH_SDCC;
+#else
+	bench.compiler = BENCH_C51;
+#endif
+
+	hsk_boot_extClock(CLK);
+
+	hsk_can_init(CAN1_IO, CAN1_BAUD);
+	msg = hsk_can_msg_create(0x7ff, 0, 8);
+	hsk_can_msg_connect(msg, CAN1);
+	hsk_can_msg_setData(msg, data);
+	hsk_can_enable(CAN1);
+
+	filter_init();
+	for (i = 0; i < 8; i++) {
+		filter_update(i);
+	}
+
+	hsk_pwc_init(4);
+	hsk_pwc_port_open(PWC_CC0_P40, 2);
+	hsk_pwc_channel_edgeMode(PWC_CC0, PWC_EDGE_BOTH);
+
+	hsk_ex_channel_enable(EX_EXINT2, EX_EDGE_RISING, &bench_exint2);
+
+	/* Timer 1 in 16 bit mode, not gated. */
+	TMOD = TMOD & 0x0f | 0x10;
+
+	BENCH_START();
+	BENCH_STOP(bench.overhead);
+
+	BENCH_START();
+	hsk_can_data_getSignal(data, CAN_ENDIAN_MOTOROLA, 0, 7, 16);
+	BENCH_STOP(counts);
+	BENCH_STORE(BENCH_GETSIGNAL_MOTOROLA, counts);
+
+	BENCH_START();
+	hsk_can_data_getSignal(data, CAN_ENDIAN_INTEL, 1, 4, 12);
+	BENCH_STOP(counts);
+	BENCH_STORE(BENCH_GETSIGNAL_INTEL, counts);
+
+	BENCH_START();
+	hsk_can_msg_getData(msg, data);
+	BENCH_STOP(counts);
+	BENCH_STORE(BENCH_MSG_GETDATA, counts);
+
+	BENCH_START();
+	filter_update(0x1234);
+	BENCH_STOP(counts);
+	BENCH_STORE(BENCH_FILTER_UPDATE, counts);
+
+	BENCH_START();
+	hsk_pwc_channel_getValue(PWC_CC0, PWC_UNIT_WIDTH_US);
+	BENCH_STOP(counts);
+	BENCH_STORE(BENCH_PWC_GETVALUE, counts);
+
+	/* Trigger EXINT2 by software and wait for the callback. */
+	exint2 = 0;
+	EA = 1;
+	BENCH_START();
+	IRCON0 |= 1 << BIT_EXINT2;
+	while (!exint2);
+	BENCH_STOP(counts);
+	EA = 0;
+	BENCH_STORE(BENCH_ISR8_EXINT2, counts);
+
+	bench.done = BENCH_DONE;
+	while (1);
+}
+
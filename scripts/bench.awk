@@ -0,0 +1,68 @@
+#!/usr/bin/awk -f
+#
+# Creates a markdown table from the benchmark log of uVision/bench.ini.
+#
+# The log contains lines of the following format:
+#
+#	BENCH <compiler> <name> <timer counts>
+#
+# The compiler is 1 for SDCC and 2 for C51. If a benchmark was logged
+# several times for the same compiler, the last result wins.
+#
+# The table lists the timer counts and PCLK cycles of every benchmark
+# for both compilers, timer 1 counts every second PCLK cycle.
+#
+
+##
+# Set up the compiler names.
+#
+BEGIN {
+	compilers[1] = "SDCC"
+	compilers[2] = "C51"
+}
+
+##
+# Collect results.
+#
+# Lines are stripped of carriage returns, because µVision creates DOS
+# line endings.
+#
+/^BENCH [0-9]+ / {
+	sub(/\r$/, "")
+	if (!($3 in names)) {
+		names[$3]
+		order[++order_i] = $3
+	}
+	counts[$2, $3] = $4
+}
+
+##
+# Format a single result.
+#
+# @param compiler
+#	The compiler number
+# @param name
+#	The benchmark name
+# @return
+#	The timer counts and cycles or "-" if not available
+#
+function result(compiler, name) {
+	if (!((compiler, name) in counts)) {
+		return "-"
+	}
+	if (counts[compiler, name] == 65535) {
+		return "overflow"
+	}
+	return counts[compiler, name] " (" counts[compiler, name] * 2 " cycles)"
+}
+
+##
+# Print the table.
+#
+END {
+	print "| Benchmark | " compilers[1] " | " compilers[2] " |"
+	print "|-----------|------|-----|"
+	for (i = 1; i <= order_i; i++) {
+		print "| " order[i] " | " result(1, order[i]) " | " result(2, order[i]) " |"
+	}
+}
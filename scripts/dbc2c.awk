@@ -41,6 +41,13 @@
 #
 # It defaults to the output of the \c date command.
 #
+# \subsection dbc2c_env_FILTERS FILTERS
+#
+# The number of acceptance filters (i.e. message objects or FIFOs) to plan
+# for every ECU, see \ref dbc2c_templates_filter.
+#
+# It defaults to 8.
+#
 # \section dbc2c_vts Value Tables
 #
 # Since values in value tables only consist of a number and description,
@@ -180,6 +187,44 @@
 # | rx       | string[] | A list of signals received by this ECU
 # | rxid     | string[] | A list of unique signal identifiers received by this ECU
 #
+# \subsection dbc2c_templates_filter filter.tpl
+#
+# Used for each acceptance filter planned for an ECU. The filters are
+# planned by planFilters(), which tries to cover all messages received
+# by the ECU with the number of ID/mask pairs given by \ref dbc2c_env_FILTERS,
+# accepting as few unwanted IDs as possible. Standard and extended IDs
+# are never mixed in a filter.
+#
+# | Field    | Type     | Description
+# |----------|----------|-------------
+# | ecu      | string   | The ECU receiving through this filter
+# | n        | int      | The number of the filter for this ECU
+# | id       | int      | The ID to match
+# | ext      | bool     | The ID is extended
+# | msk      | int      | The bit mask of ID bits that have to match
+# | fp       | int      | The number of accepted IDs not received by the ECU
+# | msgname  | string[] | The names of the messages accepted by the filter
+#
+# \subsection dbc2c_templates_rxids rxids.tpl
+#
+# Used once for each ECU after the filters, to provide a secondary
+# software filter for IDs accepted by accident.
+#
+# | Field    | Type     | Description
+# |----------|----------|-------------
+# | ecu      | string   | The ECU
+# | filters  | int      | The number of planned filters
+# | std      | int[]    | The sorted standard IDs of messages received by the ECU
+# | stdcnt   | int      | The number of standard IDs
+# | ext      | int[]    | The sorted extended IDs of messages received by the ECU
+# | extcnt   | int      | The number of extended IDs
+# | nostd    | bool     | Indicates that there are no standard IDs
+# | noext    | bool     | Indicates that there are no extended IDs
+# | inexact  | bool     | Indicates that filters accept unwanted IDs
+#
+# Empty lists need a placeholder entry, because an empty initializer
+# is not valid C.
+#
 # \subsection dbc2c_templates_msg msg.tpl
 #
 # Used for each message with the following arguments:
@@ -237,6 +282,10 @@
 # | off      | int      | The raw offset value
 # | getbuf   | string[] | The output of <tt>sig_getbuf.tpl</tt>
 # | setbuf   | string[] | The output of <tt>sig_setbuf.tpl</tt>
+# | type     | string   | The narrowest unsigned type containing the signal
+# | int8     | bool     | Indicates whether an 8 bit integer suffices to contain the signal
+# | int16    | bool     | Indicates whether a 16 bit integer suffices to contain the signal
+# | int32    | bool     | Indicates whether a 32 bit integer suffices to contain the signal
 #
 # \subsubsection dbc2c_templates_sig_calc16 calc16
 #
@@ -278,6 +327,12 @@
 # | int8     | bool     | Indicates whether an 8 bit integer suffices to address the desired bit
 # | int16    | bool     | Indicates whether a 16 bit integer suffices to address the desired bit
 # | int32    | bool     | Indicates whether a 32 bit integer suffices to address the desired bit
+# | full     | bool     | Indicates that the signal covers the entire byte
+# | part     | bool     | Indicates that the signal only covers a part of the byte
+#
+# The \c full and \c part fields allow <tt>sig_setbuf.tpl</tt> to
+# replace the read-modify-write sequence with a plain assignment
+# when a byte belongs to the signal entirely.
 #
 # \subsubsection dbc2c_templates_sig_enum sig_enum.tpl, sig_enumval.tpl
 #
@@ -331,6 +386,8 @@ BEGIN {
 	DEBUG = (DEBUG ? DEBUG : ENVIRON["DEBUG"])
 	TEMPLATES = (TEMPLATES ? TEMPLATES : ENVIRON["TEMPLATES"])
 	DATE = (DATE ? DATE : ENVIRON["DATE"])
+	FILTERS = (FILTERS ? FILTERS : ENVIRON["FILTERS"])
+	FILTERS = (FILTERS > 0 ? int(FILTERS) : 8)
 
 	# Template directory
 	if (!TEMPLATES) {
@@ -1754,6 +1811,8 @@ function template(data, name,
 # Creates the entries int8, int16 and int32 in the given arrays, with the
 # fitting type set to the value 1 and the others to 0.
 #
+# The entry type is set to the name of the fitting unsigned type.
+#
 # @param array
 #	The array put the entries into
 # @param bitpos
@@ -1763,6 +1822,167 @@ function setTypes(array, bitpos) {
 	array["int32"] = (bitpos >= 16 ? 1 : 0)
 	array["int16"] = (!array["int32"] && bitpos >= 8 ? 1 : 0)
 	array["int8"] = (bitpos < 8 ? 1 : 0)
+	array["type"] = (array["int32"] ? "ulong" : array["int16"] ? "uword" : "ubyte")
+}
+
+##
+# Returns the bitwise and of two unsigned integers.
+#
+# This is implemented arithmetically, because POSIX awk does not provide
+# bitwise operators.
+#
+# @param a, b
+#	The integers to combine
+# @param bits
+#	The number of bits to regard
+# @return
+#	The bitwise and of a and b
+#
+function bitand(a, b, bits,
+	result, p) {
+	result = 0
+	for (p = 1; bits-- > 0; p *= 2) {
+		if (int(a / p) % 2 && int(b / p) % 2) {
+			result += p
+		}
+	}
+	return result
+}
+
+##
+# Returns the mask of bits equal in two unsigned integers.
+#
+# @param a, b
+#	The integers to compare
+# @param bits
+#	The number of bits to regard
+# @return
+#	A mask with all bits set that are equal in a and b
+#
+function biteq(a, b, bits,
+	result, p) {
+	result = 0
+	for (p = 1; bits-- > 0; p *= 2) {
+		if (int(a / p) % 2 == int(b / p) % 2) {
+			result += p
+		}
+	}
+	return result
+}
+
+##
+# Returns the number of IDs accepted by a mask.
+#
+# @param msk
+#	The acceptance mask
+# @param bits
+#	The number of ID bits
+# @return
+#	Two to the power of the unset mask bits
+#
+function accepted(msk, bits,
+	result) {
+	result = 1
+	for (; bits-- > 0; msk = int(msk / 2)) {
+		if (!(msk % 2)) {
+			result *= 2
+		}
+	}
+	return result
+}
+
+##
+# Plans a set of acceptance filters for a list of messages.
+#
+# Every message starts out with its own filter. Then the pair of filters
+# with the least additional unwanted IDs is merged, until the number of
+# filters is down to the given limit. Merges that do not admit unwanted
+# IDs are always performed.
+#
+# @param count
+#	The number of messages
+# @param msgs
+#	An array of message references, indexed from 0
+# @param limit
+#	The desired number of filters
+# @param fid
+#	Returns the filter IDs
+# @param fext
+#	Returns whether the filters use extended IDs
+# @param fmsk
+#	Returns the filter masks
+# @param fmem
+#	Returns the message references accepted by each filter, RS separated
+# @param fcnt
+#	Returns the number of messages accepted by each filter
+# @return
+#	The number of filters
+#
+function planFilters(count, msgs, limit, fid, fext, fmsk, fmem, fcnt,
+	i, j, bits, msk, cost, best, bi, bj) {
+	for (i = 0; i < count; i++) {
+		fid[i] = msgid(msgs[i])
+		fext[i] = msgidext(msgs[i])
+		fmsk[i] = 2^(fext[i] ? 29 : 11) - 1
+		fmem[i] = msgs[i] RS
+		fcnt[i] = 1
+	}
+	while (count > 1) {
+		best = -1
+		for (i = 0; i < count; i++) {
+			for (j = i + 1; j < count; j++) {
+				if (fext[i] != fext[j]) {
+					continue
+				}
+				bits = (fext[i] ? 29 : 11)
+				msk = bitand(fmsk[i], fmsk[j], bits)
+				msk = bitand(msk, biteq(fid[i], fid[j], bits), bits)
+				cost = accepted(msk, bits) - accepted(fmsk[i], bits) \
+				       - accepted(fmsk[j], bits)
+				if (best < 0 || cost < best) {
+					best = cost
+					bi = i
+					bj = j
+				}
+			}
+		}
+		if (best < 0 || (best > 0 && count <= limit)) {
+			break
+		}
+		# Merge bj into bi and move the last filter into bj
+		bits = (fext[bi] ? 29 : 11)
+		fmsk[bi] = bitand(bitand(fmsk[bi], fmsk[bj], bits), \
+		                  biteq(fid[bi], fid[bj], bits), bits)
+		fid[bi] = bitand(fid[bi], fmsk[bi], bits)
+		fmem[bi] = fmem[bi] fmem[bj]
+		fcnt[bi] += fcnt[bj]
+		--count
+		fid[bj] = fid[count]
+		fext[bj] = fext[count]
+		fmsk[bj] = fmsk[count]
+		fmem[bj] = fmem[count]
+		fcnt[bj] = fcnt[count]
+	}
+	return count
+}
+
+##
+# Sorts an array of numbers in ascending order.
+#
+# @param count
+#	The number of array entries
+# @param array
+#	The array to sort, indexed from 0
+#
+function sortNum(count, array,
+	i, j, tmp) {
+	for (i = 1; i < count; i++) {
+		tmp = array[i]
+		for (j = i; j > 0 && array[j - 1] > tmp; j--) {
+			array[j] = array[j - 1]
+		}
+		array[j] = tmp
+	}
 }
 
 ##
@@ -1904,6 +2124,72 @@ END {
 		tpl["rx"] = rx
 		# Load template
 		printf("%s", template(tpl, "ecu.tpl"))
+
+		# Collect the RX messages
+		delete rxmsgs
+		delete rxseen
+		cnt = p = 0
+		while (obj_ecu_rx[ecu, p]) {
+			split(obj_ecu_rx[ecu, p++], a, SUBSEP)
+			if (!(a[1] in rxseen)) {
+				rxseen[a[1]]
+				rxmsgs[cnt++] = a[1]
+			}
+		}
+		# Plan filters
+		delete fid
+		delete fext
+		delete fmsk
+		delete fmem
+		delete fcnt
+		filters = planFilters(cnt, rxmsgs, FILTERS, fid, fext, fmsk, fmem, fcnt)
+		exact = 1
+		for (i = 0; i < filters; i++) {
+			delete ftpl
+			ftpl["ecu"] = ecu
+			ftpl["n"] = i
+			ftpl["id"] = fid[i]
+			ftpl["ext"] = fext[i]
+			ftpl["msk"] = fmsk[i]
+			ftpl["fp"] = accepted(fmsk[i], fext[i] ? 29 : 11) - fcnt[i]
+			exact = exact && !ftpl["fp"]
+			split(fmem[i], a, RS)
+			names = ""
+			for (p = 1; p <= fcnt[i]; p++) {
+				names = names obj_msg_name[a[p]] RS
+			}
+			ftpl["msgname"] = names
+			printf("%s", template(ftpl, "filter.tpl"))
+		}
+		# Sorted ID lists for secondary filtering
+		delete stds
+		delete exts
+		scnt = ecnt = 0
+		for (p = 0; p < cnt; p++) {
+			if (msgidext(rxmsgs[p])) {
+				exts[ecnt++] = 0 + msgid(rxmsgs[p])
+			} else {
+				stds[scnt++] = 0 + msgid(rxmsgs[p])
+			}
+		}
+		sortNum(scnt, stds)
+		sortNum(ecnt, exts)
+		delete ftpl
+		ftpl["ecu"] = ecu
+		ftpl["filters"] = filters
+		ftpl["inexact"] = !exact
+		ftpl["stdcnt"] = scnt
+		ftpl["extcnt"] = ecnt
+		ftpl["nostd"] = !scnt
+		ftpl["noext"] = !ecnt
+		ftpl["std"] = ftpl["ext"] = ""
+		for (p = 0; p < scnt; p++) {
+			ftpl["std"] = ftpl["std"] stds[p] RS
+		}
+		for (p = 0; p < ecnt; p++) {
+			ftpl["ext"] = ftpl["ext"] exts[p] RS
+		}
+		printf("%s", template(ftpl, "rxids.tpl"))
 	}
 
 	# Introduce the Messages
@@ -2024,6 +2310,7 @@ END {
 		tpl["max"] = sprintf("%.0f", (obj_sig_max[sig] - obj_sig_off[sig]) / obj_sig_fac[sig])
 		tpl["off"] = sprintf("%.0f", obj_sig_off[sig] / obj_sig_fac[sig])
 		# Getter and setter
+		setTypes(tpl, obj_sig_len[sig] - 1)
 		bits = obj_sig_len[sig]
 		bpos = obj_sig_sbit[sig]
 		if (obj_sig_intel[sig]) {
@@ -2057,6 +2344,8 @@ END {
 				sbits["#mask"] = "msk"
 				sbits["pos"] = pos
 				setTypes(sbits, sbits["pos"] + shift - 1)
+				sbits["full"] = (shift == 8)
+				sbits["part"] = !sbits["full"]
 				tpl["getbuf"] = tpl["getbuf"] \
 				                template(sbits, "sig_getbuf.tpl")
 				tpl["setbuf"] = tpl["setbuf"] \
@@ -2095,6 +2384,8 @@ END {
 				sbits["#mask"] = "msk"
 				sbits["pos"] = bits - slice
 				setTypes(sbits, sbits["pos"] + slice - 1)
+				sbits["full"] = (slice == 8)
+				sbits["part"] = !sbits["full"]
 				tpl["getbuf"] = tpl["getbuf"] \
 				                template(sbits, "sig_getbuf.tpl")
 				tpl["setbuf"] = tpl["setbuf"] \
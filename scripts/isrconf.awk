@@ -0,0 +1,180 @@
+#!/usr/bin/awk -f
+#
+# Generates the shared ISR configuration header hsk_isr_conf.h from C files.
+#
+# The header defines HSK_ISRn_SOURCE for every shared ISR source a callback
+# is registered for, only these sources are compiled into the shared ISRs.
+# It also defines HSK_ISR_CONF, without it hsk_isr.c compiles all sources.
+#
+# Registrations are detected in the following forms:
+# - hsk_isrN.SOURCE = &callback;
+# - hsk_isrN.SOURCE = callback;
+# - Calls of hsk_ex_channel_enable() and hsk_ex_channel_debounce()
+#
+# Other forms, e.g. assignments through a pointer, are not detected.
+#
+# Only the sources linked into the binary should be passed, as listed by
+# linksrc.awk, otherwise unused modules enable their ISR sources:
+#
+#	awk -f scripts/isrconf.awk $(awk -f scripts/linksrc.awk gen/build.mk) \
+#	    -Iinc/ -Igen/ -DSDCC > gen/hsk_isr_conf.h
+#
+# This script directly makes use of the coding conventions of the hsk_libs
+# and uses internal knowledge, which makes it useless for any other
+# purpose.
+#
+
+##
+# Pass all arguments to cstrip.awk and pass the output to TMPFILE.
+#
+# Creates the following globals:
+# - DEBUG: Created from the environment variable with the same name
+# - LIBPROJDIR: Created from the environment variable with the same name
+#   it is used to access cstrip.awk
+# - TMPFILE: The file containing the output of cstrip.awk
+#
+BEGIN {
+	# Get environment settings
+	DEBUG = ENVIRON["DEBUG"]
+	LIBPROJDIR = ENVIRON["LIBPROJDIR"]
+	sub(/[^\/]$/, "&/", LIBPROJDIR)
+	if (DEBUG) {
+		print "isrconf.awk: LIBPROJDIR = " LIBPROJDIR > "/dev/stderr"
+	}
+
+	# Get a unique temporary file
+	cmd = "sh -c 'printf $$'"
+	cmd | getline TMPFILE
+	close(cmd)
+	TMPFILE = "/tmp/isrconf.awk." TMPFILE
+	# Get cstrip cmd
+	cmd = ARGV[0] " -f " LIBPROJDIR "scripts/cstrip.awk"
+	for (i = 1; i < ARGC; i++) {
+		cmd = cmd " '" ARGV[i] "'"
+	}
+	system(cmd ">" TMPFILE)
+	delete ARGV
+	ARGV[1] = TMPFILE
+	ARGC = 2
+
+	# External interrupt channels served by shared ISRs
+	exint[2] = "HSK_ISR8_EXINT2"
+	exint[3] = "HSK_ISR9_EXINT3"
+	exint[4] = "HSK_ISR9_EXINT4"
+	exint[5] = "HSK_ISR9_EXINT5"
+	exint[6] = "HSK_ISR9_EXINT6"
+}
+
+##
+# Get filename, useful for debugging.
+#
+/^#[0-9]+".*"/ {
+	sub(/^#[0-9]+"/, "");
+	sub(/".*/, "");
+	filename = $0
+	next
+}
+
+##
+# Add a source to the configuration.
+#
+# @param source
+#	The macro name of the source
+#
+function register(source) {
+	if (DEBUG) {
+		print "isrconf.awk: " filename ": " source > "/dev/stderr"
+	}
+	if (!registered[source]++) {
+		sources[++sources_i] = source
+	}
+}
+
+##
+# Collect function names.
+#
+# Callbacks assigned without the address operator must be one of them,
+# which rules out assignments from variables.
+#
+/^[^(=;{}]+[ *][a-zA-Z_][a-zA-Z0-9_]*\(/ {
+	name = $0
+	sub(/\(.*/, "", name)
+	sub(/.*[ *]/, "", name)
+	functions[name]
+}
+
+##
+# Catch shared ISR callback registrations.
+#
+# Functions and their addresses are accepted. Assignments from function
+# arguments are done by library functions like hsk_ex_channel_enable(),
+# which are caught separately.
+#
+# Functions can be assigned before they are declared, so assignments
+# without the address operator are checked at the end.
+#
+/^hsk_isr[0-9]+\.[a-zA-Z0-9_]+=&?[a-zA-Z_][a-zA-Z0-9_]*;/ {
+	callback = $0
+	sub(/.*=/, "", callback)
+	sub(/;.*/, "", callback)
+	sub(/=.*/, "")
+	sub(/\./, "_")
+	if (callback ~ /^&/) {
+		register(toupper($0))
+	} else {
+		plain[++plain_i] = toupper($0)
+		plain_callback[plain_i] = callback
+	}
+}
+
+##
+# Catch external interrupts.
+#
+# If the channel cannot be determined all shared external interrupts
+# are registered.
+#
+/^hsk_ex_channel_(enable|debounce)\(/ {
+	chan = $0
+	sub(/hsk_ex_channel_[a-z]+\(/, "", chan)
+	sub(/,.*/, "", chan)
+	if (chan ~ /^[0-9]+$/) {
+		if (chan in exint) {
+			register(exint[chan])
+		}
+	} else {
+		for (chan = 2; chan <= 6; chan++) {
+			register(exint[chan])
+		}
+	}
+}
+
+##
+# Remove TMPFILE and print the header.
+#
+END {
+	# Stop writing to TMPFILE
+	close(TMPFILE)
+	cmd = "rm " TMPFILE
+	system(cmd)
+
+	# Register assignments of functions
+	for (i = 1; i <= plain_i; i++) {
+		if (plain_callback[i] in functions) {
+			register(plain[i])
+		}
+	}
+
+	print "/** \\file"
+	print " * Shared ISR configuration, generated by isrconf.awk."
+	print " */"
+	print ""
+	print "#ifndef _HSK_ISR_CONF_H_"
+	print "#define _HSK_ISR_CONF_H_"
+	print ""
+	print "#define HSK_ISR_CONF"
+	for (i = 1; i <= sources_i; i++) {
+		print "#define " sources[i]
+	}
+	print ""
+	print "#endif /* _HSK_ISR_CONF_H_ */"
+}
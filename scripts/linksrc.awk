@@ -0,0 +1,62 @@
+#!/usr/bin/awk -f
+#
+# Lists the sources of all objects linked into the binaries of a build.
+#
+# The input is the output of build.awk, the sources of the objects linked
+# into every binary of the build target are printed, one per line:
+#
+#	awk -f scripts/linksrc.awk gen/build.mk
+#
+# This is used to only let modules that are actually linked contribute
+# to the shared ISR configuration.
+#
+# This script directly makes use of the output format of build.awk,
+# which makes it useless for any other purpose.
+#
+
+##
+# Collect the dependencies of every object and binary rule.
+#
+# The first dependency of an object is its source.
+#
+# Creates the following globals:
+# - SRC: Map: target → first dependency
+# - DEPS: Map: target → all dependencies
+#
+/^\$\{OBJDIR\}[^ :]*:/ {
+	target = $1
+	sub(/:$/, "", target)
+	SRC[target] = $2
+	DEPS[target] = $0
+	sub(/^[^ ]* ?/, "", DEPS[target])
+	next
+}
+
+##
+# Collect the binaries of the build target.
+#
+# Creates the following globals:
+# - BUILD: The binaries of the build target
+#
+/^build:/ {
+	BUILD = $0
+	sub(/^build: ?/, "", BUILD)
+	next
+}
+
+##
+# Print the sources of all objects linked into the binaries.
+#
+END {
+	bins = split(BUILD, BINS, / /)
+	for (i = 1; i <= bins; i++) {
+		objs = split(DEPS[BINS[i]], OBJS, / /)
+		for (o = 1; o <= objs; o++) {
+			obj = OBJS[o]
+			if ((obj in SRC) && !(obj in PRINTED)) {
+				PRINTED[obj]
+				print SRC[obj]
+			}
+		}
+	}
+}
@@ -0,0 +1,702 @@
+#!/usr/bin/awk -f
+#
+# Reports memory use per module and the worst case stack use per call
+# tree root of a binary.
+#
+# The script accepts the following input files:
+#
+# | File            | Description
+# |-----------------|-----------------------------------------------------
+# | \<binary\>.lk   | The SDCC linker script of a binary
+# | \<binary\>.m51  | The C51 map file of a binary
+# | any other file  | The output of overlays.awk
+#
+# SDCC linker scripts list the objects of a binary. For every object the
+# area sizes are read from the .rel file and the call tree is read from
+# the .asm file, which SDCC places next to the object. The space left for
+# the stack is read from the \<binary\>.mem file.
+#
+# SDCC calls ISR callbacks through function pointers, which cannot be
+# followed in the assembler output. The output of overlays.awk provides
+# the callbacks of every ISR and the register bank groups of ISRs, which
+# are used to complete the call tree.
+#
+# C51 map files contain the memory map and the call tree, which already
+# contains the overlay directives. The map does not tell how many bytes a
+# function pushes, so only return addresses are accounted for, results
+# are lower bounds.
+#
+# The worst case stack use of a call tree is the sum of return addresses
+# and pushes along its most expensive path. Calls to functions not found
+# in the input, e.g. the compiler runtime, and function pointer calls that
+# could not be resolved are counted with a return address only and mark
+# the result as a lower bound (≥). Recursion is reported and not followed.
+#
+# ISRs using the same register bank must not interrupt each other, so the
+# hsk_isr_rootN() functions of overlays.awk group them into a single call
+# tree. The worst case of the whole binary is the sum of all root call
+# trees, i.e. main() interrupted by a single ISR of every group.
+#
+# The report is printed as markdown, the following example creates the
+# report for an SDCC build:
+#
+#	awk -f scripts/overlays.awk $(awk -f scripts/linksrc.awk gen/build.mk) \
+#	    -Iinc/ -Igen/ > gen/overlays.txt
+#	awk -f scripts/memreport.awk gen/overlays.txt bin.sdcc/main.lk
+#
+# For a µVision build the map file is passed instead:
+#
+#	awk -f scripts/memreport.awk uVision/hsk_libs.m51
+#
+
+##
+# Set up the memory categories.
+#
+# Creates the following globals:
+# - CATEGORIES: The number of memory categories
+# - CATEGORY: Maps category number → category name
+# - AREAS: Maps SDCC area name → category name
+# - SEGMENTS: Maps C51 segment prefix → category name
+#
+BEGIN {
+	CATEGORIES = split("code data overlay idata bits pdata xdata", CATEGORY)
+
+	AREAS["CSEG"] = "code"
+	AREAS["CONST"] = "code"
+	AREAS["HOME"] = "code"
+	AREAS["GSINIT"] = "code"
+	AREAS["GSFINAL"] = "code"
+	AREAS["XINIT"] = "code"
+	AREAS["DSEG"] = "data"
+	AREAS["DABS"] = "data"
+	AREAS["OSEG"] = "overlay"
+	AREAS["ISEG"] = "idata"
+	AREAS["IABS"] = "idata"
+	AREAS["BSEG"] = "bits"
+	AREAS["PSEG"] = "pdata"
+	AREAS["XSEG"] = "xdata"
+	AREAS["XISEG"] = "xdata"
+	AREAS["XABS"] = "xdata"
+
+	SEGMENTS["PR"] = "code"
+	SEGMENTS["CO"] = "code"
+	SEGMENTS["DT"] = "data"
+	SEGMENTS["ID"] = "idata"
+	SEGMENTS["BI"] = "bits"
+	SEGMENTS["PD"] = "pdata"
+	SEGMENTS["XD"] = "xdata"
+}
+
+##
+# Convert a hexadecimal number.
+#
+# @param str
+#	The number with or without 0x prefix or H suffix
+# @return
+#	The numerical value
+#
+function hex(str,
+             i, value) {
+	sub(/^0[xX]/, "", str)
+	sub(/[hH]$/, "", str)
+	str = toupper(str)
+	value = 0
+	for (i = 1; i <= length(str); i++) {
+		value = value * 16 + index("0123456789ABCDEF", substr(str, i, 1)) - 1
+	}
+	return value
+}
+
+##
+# Account memory to a module.
+#
+# Creates the following globals:
+# - MODULE: Maps module number → module name
+# - MODULES: The number of modules
+# - SIZE: Maps (module name, category name) → bytes, bits for "bits"
+#
+# @param module
+#	The module name
+# @param category
+#	The category name
+# @param size
+#	The amount of memory
+#
+function account(module, category, size) {
+	if (!((module, "code") in SIZE)) {
+		MODULE[++MODULES] = module
+		SIZE[module, "code"] = 0
+	}
+	SIZE[module, category] += size
+}
+
+##
+# Add a call to the call tree.
+#
+# Creates the following globals:
+# - CALLS: Maps function → number of calls
+# - CALL: Maps (function, call number) → called function
+# - COST: Maps (function, call number) → stack bytes of the call itself
+# - CALLED: Set of functions that are called
+#
+# @param caller
+#	The calling function
+# @param callee
+#	The called function
+# @param cost
+#	The stack bytes taken by the call
+#
+function call(caller, callee, cost) {
+	CALL[caller, ++CALLS[caller]] = callee
+	COST[caller, CALLS[caller]] = cost
+	CALLED[callee]
+}
+
+##
+# Read the area sizes from an SDCC object.
+#
+# Area lines in .rel files have the following format:
+#
+#	A <area> size <hex> flags <flags> addr <hex>
+#
+# Register bank areas are collected in BANK, which maps bank → modules.
+#
+# @param file
+#	The .rel file
+#
+function readRel(file,
+                 module, line, field, bank) {
+	module = file
+	sub(/.*\//, "", module)
+	sub(/\.rel$/, "", module)
+	account(module, "code", 0)
+	while ((getline line < file) > 0) {
+		if (line !~ /^A /) {
+			continue
+		}
+		split(line, field, " ")
+		if (field[2] in AREAS) {
+			account(module, AREAS[field[2]], hex(field[4]))
+		} else if (field[2] ~ /^REG_BANK_[0-3]$/) {
+			bank = substr(field[2], 10)
+			if (bank in BANK) {
+				BANK[bank] = BANK[bank] ", " module
+			} else {
+				BANK[bank] = module
+			}
+		}
+	}
+	close(file)
+}
+
+##
+# Read the call tree from SDCC assembler output.
+#
+# Functions start with a comment line consisting of "function" and the
+# name of the function. Every push and every stack pointer adjustment
+# for reentrant locals is added to the stack use of the function.
+# lcall/acall instructions add calls, ljmp instructions to other
+# functions are tail calls. Calls through __sdcc_call_dptr are function
+# pointer calls.
+#
+# Creates the following globals:
+# - FUNCS: Maps function → stack bytes used by the function itself
+# - ISR: Set of functions returning with reti
+# - INDIRECT: Set of functions with function pointer calls
+#
+# Tail calls are added to the call tree without a return address.
+#
+# @param file
+#	The .asm file
+#
+function readAsm(file,
+                 line, func, target, sp, adjust) {
+	func = ""
+	sp = 0
+	while ((getline line < file) > 0) {
+		if (line ~ /^;[ \t]+function [A-Za-z0-9_]+/) {
+			func = line
+			sub(/^;[ \t]+function /, "", func)
+			sub(/[^A-Za-z0-9_].*/, "", func)
+			FUNCS[func] = 0
+			continue
+		}
+		if (!func) {
+			continue
+		}
+		if (line ~ /^[ \t]+push[ \t]/) {
+			FUNCS[func]++
+		} else if (line ~ /^[ \t]+[al]call[ \t]+_/) {
+			target = line
+			sub(/^[ \t]+[al]call[ \t]+_/, "", target)
+			sub(/[^A-Za-z0-9_].*/, "", target)
+			if (target == "_sdcc_call_dptr") {
+				INDIRECT[func]
+			} else {
+				call(func, target, 2)
+			}
+		} else if (line ~ /^[ \t]+ljmp[ \t]+_/) {
+			target = line
+			sub(/^[ \t]+ljmp[ \t]+_/, "", target)
+			sub(/[^A-Za-z0-9_].*/, "", target)
+			call(func, target, 0)
+		} else if (line ~ /^[ \t]+reti/) {
+			ISR[func]
+		}
+		# mov a,sp; add a,#n; mov sp,a
+		if (sp == 1 && line ~ /^[ \t]+add[ \t]+a,#0x[0-9a-fA-F]+/) {
+			adjust = line
+			sub(/^[ \t]+add[ \t]+a,#/, "", adjust)
+			sub(/[^0-9a-fA-Fx].*/, "", adjust)
+			adjust = hex(adjust)
+			sp = 2
+		} else if (sp == 2 && line ~ /^[ \t]+mov[ \t]+sp,a/) {
+			if (adjust < 128) {
+				FUNCS[func] += adjust
+			}
+			sp = 0
+		} else {
+			sp = line ~ /^[ \t]+mov[ \t]+a,sp/
+		}
+	}
+	close(file)
+}
+
+##
+# Read the available stack from the SDCC memory summary.
+#
+# Creates the global STACK, the number of bytes left for the stack.
+#
+# @param file
+#	The .mem file
+#
+function readMem(file,
+                 line) {
+	while ((getline line < file) > 0) {
+		if (line ~ /^Stack starts at: .* with [0-9]+ bytes available/) {
+			sub(/ bytes available.*/, "", line)
+			sub(/.* /, "", line)
+			STACK = line
+		}
+	}
+	close(file)
+}
+
+##
+# Process SDCC linker scripts.
+#
+# Every object is read, the .mem file belongs to the linker script.
+#
+# Creates the global SDCC to select SDCC mode.
+#
+FILENAME ~ /\.lk$/ {
+	if (FNR == 1) {
+		SDCC = 1
+		BINARY = FILENAME
+		sub(/\.lk$/, "", BINARY)
+		readMem(BINARY ".mem")
+	}
+	sub(/\r$/, "")
+}
+
+FILENAME ~ /\.lk$/ && /\.rel$/ {
+	readRel($0)
+	obj = $0
+	sub(/\.rel$/, ".asm", obj)
+	readAsm(obj)
+	next
+}
+
+FILENAME ~ /\.lk$/ {
+	next
+}
+
+##
+# Process C51 map files.
+#
+# Creates the following globals:
+# - C51: Selects C51 mode
+# - MAP: The section of the map file that is currently processed
+#
+FILENAME ~ /\.[mM]51$/ {
+	if (FNR == 1) {
+		C51 = 1
+		BINARY = FILENAME
+		sub(/\.[mM]51$/, "", BINARY)
+		MAP = ""
+	}
+	sub(/\r$/, "")
+	if (/^OVERLAY MAP OF MODULE/) {
+		MAP = "overlay"
+		next
+	}
+	if (/^(LINK MAP OF MODULE|MEMORY MAP OF MODULE)/) {
+		MAP = "memory"
+		next
+	}
+	if (/^[A-Z][A-Z ]+(MODULE|TABLE|SUMMARY)/) {
+		MAP = ""
+		next
+	}
+}
+
+##
+# Collect the C51 memory map.
+#
+# Segment lines have the following format:
+#
+#	<type> <base>H <length>H[.<bits>] <relocation> <segment>
+#
+# The segment name contains the memory class and the module, e.g.
+# ?XD?HSK_CAN or ?PR?MAIN?MAIN. The overlayable data and bit groups
+# as well as runtime segments have names of their own.
+#
+FILENAME ~ /\.[mM]51$/ && MAP == "memory" && \
+$1 ~ /^(REG|DATA|IDATA|BIT|XDATA|CODE)$/ {
+	if (/"REG BANK [0-3]"/) {
+		bank = $0
+		sub(/.*"REG BANK /, "", bank)
+		sub(/".*/, "", bank)
+		BANK[bank] = "-"
+		next
+	}
+	size = $3
+	bits = 0
+	if (size ~ /\.[0-7]$/) {
+		bits = substr(size, length(size))
+		sub(/\.[0-7]$/, "", size)
+	}
+	size = hex(size)
+	if ($1 == "BIT") {
+		size = size * 8 + bits
+	}
+	segment = $NF
+	if ($NF == "?STACK") {
+		STACK = 256 - hex($2)
+		next
+	}
+	if (segment == "_DATA_GROUP_") {
+		account(segment, "overlay", size)
+	} else if (segment == "_BIT_GROUP_") {
+		account(segment, "bits", size)
+	} else if ((n = split(segment, field, "?")) >= 3 && (field[2] in SEGMENTS)) {
+		account(field[n], SEGMENTS[field[2]], size)
+	} else {
+		account("(runtime)", $1 == "BIT" ? "bits" : \
+		                     $1 == "XDATA" ? "xdata" : \
+		                     $1 == "CODE" ? "code" : "data", size)
+	}
+	next
+}
+
+##
+# Get the function name from a C51 code segment.
+#
+# Functions with register parameters are prefixed with an underscore.
+#
+# @param segment
+#	The segment name, e.g. ?PR?_HSK_CAN_INIT?HSK_CAN
+# @return
+#	The function name, e.g. HSK_CAN_INIT
+#
+function c51func(segment) {
+	sub(/^\?PR\?/, "", segment)
+	sub(/\?[^?]*$/, "", segment)
+	sub(/^_/, "", segment)
+	return segment
+}
+
+##
+# Collect the C51 call tree.
+#
+# The overlay map lists every function followed by the functions it
+# calls:
+#
+#	?PR?MAIN?MAIN                  0008H    0003H
+#	  +--> ?PR?_HSK_CAN_INIT?HSK_CAN
+#
+FILENAME ~ /\.[mM]51$/ && MAP == "overlay" && /^[?*]/ {
+	split($0, field, " ")
+	caller = field[1]
+	if (caller ~ /^\?PR\?/) {
+		caller = c51func(caller)
+	} else if (caller !~ /^\?/) {
+		# *** NEW ROOT ***
+		caller = ""
+		next
+	}
+	if (!(caller in FUNCS)) {
+		FUNCS[caller] = 0
+	}
+	next
+}
+
+FILENAME ~ /\.[mM]51$/ && MAP == "overlay" && caller != "" && \
+/^[ \t]+\+--> \?PR\?/ {
+	split($0, field, " ")
+	callee = c51func(field[2])
+	if (!(callee in FUNCS)) {
+		FUNCS[callee] = 0
+	}
+	call(caller, callee, 2)
+	next
+}
+
+FILENAME ~ /\.[mM]51$/ {
+	next
+}
+
+##
+# Collect the overlays.awk output.
+#
+# Output lines have the format "caller ! (callee, ...),", the lines
+# starting with "*" are ignored.
+#
+# Creates the following globals:
+# - OVERLAYS: The number of overlay directives
+# - OVERLAY: Maps directive number → "caller ! (callee, ...)"
+#
+/^[A-Za-z0-9_]+ ! \(/ {
+	sub(/\r$/, "")
+	sub(/,$/, "")
+	OVERLAY[++OVERLAYS] = $0
+}
+
+##
+# Add the overlay directives to the SDCC call tree.
+#
+# Callbacks are called through __sdcc_call_dptr, which takes a return
+# address. The hsk_isr_rootN() functions do not exist at run time, they
+# take the place of the interrupt.
+#
+function overlays(    i, n, caller, callees, list) {
+	for (i = 1; i <= OVERLAYS; i++) {
+		caller = OVERLAY[i]
+		sub(/ !.*/, "", caller)
+		callees = OVERLAY[i]
+		sub(/^[^(]*\(/, "", callees)
+		sub(/\).*/, "", callees)
+		n = split(callees, list, /, */)
+		if (!(caller in FUNCS)) {
+			continue
+		}
+		while (n) {
+			if (list[n] in FUNCS) {
+				call(caller, list[n], 2)
+			}
+			n--
+		}
+		delete INDIRECT[caller]
+	}
+}
+
+##
+# Determine the worst case stack use of a function.
+#
+# Creates the following globals:
+# - DEPTH: Maps function → worst case stack bytes
+# - WORST: Maps function → most expensive callee
+# - LOWER: Set of functions with a lower bound as result
+# - RECURSIVE: Set of functions with recursive calls
+#
+# @param func
+#	The function
+# @return
+#	The worst case stack use in bytes
+#
+function depth(func,
+               i, callee, cost, max) {
+	if (func in DEPTH) {
+		return DEPTH[func]
+	}
+	if (func in ACTIVE) {
+		RECURSIVE[func]
+		return 0
+	}
+	ACTIVE[func]
+	max = 0
+	WORST[func] = ""
+	if (func in INDIRECT) {
+		max = 2
+		LOWER[func]
+	}
+	if (C51) {
+		LOWER[func]
+	}
+	for (i = 1; i <= CALLS[func]; i++) {
+		callee = CALL[func, i]
+		cost = COST[func, i]
+		if (callee in FUNCS) {
+			cost += depth(callee)
+			if (callee in LOWER) {
+				LOWER[func]
+			}
+			if (callee in RECURSIVE) {
+				RECURSIVE[func]
+			}
+		} else if (cost) {
+			# Jumps to labels outside of functions are no tail calls
+			LOWER[func]
+		}
+		if (cost > max) {
+			max = cost
+			WORST[func] = callee
+		}
+	}
+	delete ACTIVE[func]
+	DEPTH[func] = FUNCS[func] + max
+	return DEPTH[func]
+}
+
+##
+# Format the worst case path of a function.
+#
+# @param func
+#	The function
+# @return
+#	The functions along the most expensive path
+#
+function path(func,
+              str, i) {
+	str = func
+	for (i = 0; WORST[func] != "" && i < 32; i++) {
+		func = WORST[func]
+		str = str " → " func
+	}
+	return str
+}
+
+##
+# Format a stack use.
+#
+# @param func
+#	The function
+# @param bytes
+#	The stack bytes
+# @return
+#	The stack bytes with the lower bound and recursion marks
+#
+function report(func, bytes) {
+	return ((func in LOWER) ? "≥" : "") bytes \
+	       ((func in RECURSIVE) ? " (recursive)" : "")
+}
+
+##
+# Print the report.
+#
+END {
+	if (SDCC) {
+		overlays()
+	}
+
+	print "# Memory of " BINARY
+	print ""
+	print "## Modules"
+	print ""
+	line = "| Module |"
+	sep = "|--------|"
+	for (c = 1; c <= CATEGORIES; c++) {
+		line = line " " CATEGORY[c] " |"
+		sep = sep "------|"
+	}
+	print line
+	print sep
+	for (m = 1; m <= MODULES; m++) {
+		line = "| " MODULE[m] " |"
+		for (c = 1; c <= CATEGORIES; c++) {
+			size = SIZE[MODULE[m], CATEGORY[c]] + 0
+			line = line " " size " |"
+			if (CATEGORY[c] == "overlay" && SDCC) {
+				# Overlay areas of all modules share memory
+				TOTAL[c] = size > TOTAL[c] ? size : TOTAL[c]
+			} else {
+				TOTAL[c] += size
+			}
+		}
+		print line
+	}
+	line = "| **total** |"
+	for (c = 1; c <= CATEGORIES; c++) {
+		line = line " **" (TOTAL[c] + 0) "** |"
+	}
+	print line
+	print ""
+	print "Bits are counted in bits, everything else in bytes."
+
+	print ""
+	print "## Register Banks"
+	print ""
+	print "| Bank | Address | Modules |"
+	print "|------|---------|---------|"
+	for (b = 0; b <= 3; b++) {
+		if ((b in BANK) || b == 0) {
+			printf "| %d | 0x%02X-0x%02X | %s |\n", \
+			       b, b * 8, b * 8 + 7, (b in BANK) ? BANK[b] : "-"
+		}
+	}
+
+	# Roots are functions nobody calls
+	for (func in FUNCS) {
+		if (!(func in CALLED) && \
+		    ((func in ISR) || func ~ /^(hsk_isr_root[0-9]+|main)$/ || C51)) {
+			ROOT[++ROOTS] = func
+		}
+	}
+	# Sort roots and ISRs by name
+	for (i = 2; i <= ROOTS; i++) {
+		for (j = i; j > 1 && ROOT[j - 1] > ROOT[j]; j--) {
+			func = ROOT[j]
+			ROOT[j] = ROOT[j - 1]
+			ROOT[j - 1] = func
+		}
+	}
+	for (func in FUNCS) {
+		if ((func in ISR) || (C51 && func ~ /^ISR_/)) {
+			INT[++INTS] = func
+		}
+	}
+	for (i = 2; i <= INTS; i++) {
+		for (j = i; j > 1 && INT[j - 1] > INT[j]; j--) {
+			func = INT[j]
+			INT[j] = INT[j - 1]
+			INT[j - 1] = func
+		}
+	}
+
+	print ""
+	print "## Interrupts"
+	print ""
+	print "| ISR | Stack | Worst case path |"
+	print "|-----|-------|-----------------|"
+	for (i = 1; i <= INTS; i++) {
+		printf "| %s | %s | %s |\n", INT[i], \
+		       report(INT[i], 2 + depth(INT[i])), path(INT[i])
+	}
+
+	print ""
+	print "## Call Tree Roots"
+	print ""
+	print "| Root | Stack | Worst case path |"
+	print "|------|-------|-----------------|"
+	total = 0
+	lower = 0
+	for (i = 1; i <= ROOTS; i++) {
+		func = ROOT[i]
+		stack = depth(func) + (tolower(func) ~ /^hsk_isr_root[0-9]+$/ ? 0 : 2)
+		total += stack
+		if (func in LOWER) {
+			lower = 1
+		}
+		printf "| %s | %s | %s |\n", func, report(func, stack), path(func)
+	}
+
+	print ""
+	printf "Worst case stack: %s%d bytes", lower ? "≥" : "", total
+	if (STACK != "") {
+		printf ", %d bytes available", STACK
+		if (total > STACK) {
+			printf ", **stack overflow**"
+		}
+	}
+	print ""
+}
@@ -98,15 +98,34 @@ DEBUG > 1 {
 	using[++using_i] = "hsk_isr_root" $0 "!" isr
 }
 
+##
+# Collect function names.
+#
+# Callbacks assigned without the address operator must be one of them,
+# which rules out assignments from variables.
+#
+/^[^(=;{}]+[ *][a-zA-Z_][a-zA-Z0-9_]*\(/ {
+	name = $0
+	sub(/\(.*/, "", name)
+	sub(/.*[ *]/, "", name)
+	functions[name]
+}
+
 ##
 # Catch shared ISRs.
 #
-/^hsk_isr[0-9]+\.[a-zA-Z0-9_]+=&[a-zA-Z0-9_]+;/ {
+# Assignments without the address operator are checked at the end,
+# only functions are accepted.
+#
+/^hsk_isr[0-9]+\.[a-zA-Z0-9_]+=&?[a-zA-Z_][a-zA-Z0-9_]*;/ {
 	if (DEBUG) {
 		print "overlays.awk: shared ISR: " $0 > "/dev/stderr"
 	}
+	if (!/=&/) {
+		plain[overlays_i + 1]
+	}
 	sub(/^/, "ISR_")
-	sub(/\..*=&/, "!")
+	sub(/\..*=&?/, "!")
 	sub(/;/, "")
 	overlays[++overlays_i] = $0
 }
@@ -124,6 +143,51 @@ DEBUG > 1 {
 	overlays[++overlays_i] = $0
 }
 
+##
+# Catch timer wheel ISR callbacks.
+#
+# The returned timer is usually assigned, so the call may be preceded by
+# an assignment.
+#
+/^([a-zA-Z0-9_.\[\]]+=)?hsk_wheel_isr_create\(&[a-zA-Z0-9_]+\);/ {
+	if (DEBUG) {
+		print "overlays.awk: wheel ISR: " $0 > "/dev/stderr"
+	}
+	sub(/^.*hsk_wheel_isr_create\(&/, "hsk_wheel_isr_tick!")
+	sub(/\);/, "")
+	overlays[++overlays_i] = $0
+}
+
+##
+# Catch SSC callbacks.
+#
+/^hsk_ssc_setCallback\(&[a-zA-Z0-9_]+\);/ {
+	if (DEBUG) {
+		print "overlays.awk: SSC ISR: " $0 > "/dev/stderr"
+	}
+	sub(/^hsk_ssc_setCallback\(&/, "ISR_hsk_ssc!")
+	sub(/\);/, "")
+	overlays[++overlays_i] = $0
+}
+
+##
+# Catch ADC filters.
+#
+# Filters are called by the ADC ISR callbacks, which callback is used
+# depends on the resolution and scan mode, so all of them are added.
+#
+/^hsk_adc_filter\([^,]+,&[a-zA-Z0-9_]+,/ {
+	if (DEBUG) {
+		print "overlays.awk: ADC filter: " $0 > "/dev/stderr"
+	}
+	sub(/^hsk_adc_filter\([^,]+,&/, "")
+	sub(/,.*/, "")
+	overlays[++overlays_i] = "hsk_adc_isr10!" $0
+	overlays[++overlays_i] = "hsk_adc_isr8!" $0
+	overlays[++overlays_i] = "hsk_adc_isr10_scan!" $0
+	overlays[++overlays_i] = "hsk_adc_isr8_scan!" $0
+}
+
 ##
 # Catch external interrupts.
 #
@@ -146,6 +210,34 @@ DEBUG > 1 {
 	}
 }
 
+##
+# Catch debounced external interrupts.
+#
+# The callbacks are provided by hsk_ex, if the channel cannot be
+# determined all of them are added.
+#
+/^hsk_ex_channel_debounce\(/ {
+	if (DEBUG) {
+		print "overlays.awk: debounced ext ISR: " $0 > "/dev/stderr"
+	}
+	chan = $0
+	sub(/hsk_ex_channel_debounce\(/, "", chan)
+	sub(/,.*/, "", chan)
+	if (chan ~ /^[0-9]+$/) {
+		first = chan
+		last = chan
+	} else {
+		first = 2
+		last = 6
+	}
+	for (chan = first; chan <= last; chan++) {
+		if (chan >= 2 && chan <= 6) {
+			overlays[++overlays_i] = "ISR_hsk_isr" (chan == 2 ? 8 : 9) \
+			                         "!hsk_ex_isr_exint" chan
+		}
+	}
+}
+
 ##
 # Remove TMPFILE and print assembled data.
 #
@@ -162,12 +254,16 @@ END {
 		callback = overlays[i]
 		sub(/!.*/, "", isr)
 		sub(/.*!/, "", callback)
+		# Skip assignments of variables
+		if ((i in plain) && !(callback in functions)) {
+			continue
+		}
 		# Fix order of isr callback groups
 		if (!callbacks[isr]) {
 			groups[++groups_i] = isr
 		}
 		# Avoid duplicates
-		if (!callback_count[callback]++) {
+		if (!callback_count[isr, callback]++) {
 			callbacks[isr] = (callbacks[isr] ? callbacks[isr] ", " : "") callback
 		}
 	}
@@ -0,0 +1,15 @@
+/**
+ * Acceptance filter <:n:> of ECU <:ecu:>.
+ *
+ * Accepts the messages:
+ * - \ref MSG_<:msgname:>
+ *
+ * Also accepts <:fp:> IDs not received by this ECU.<?fp?>
+ *<?fp?>
+ * @ingroup ECU_<:ecu:>
+ */
+//@{
+#define FILTER_<:ecu:>_<:n:>       <:id:%#x:>, <:ext:>
+#define FILTERMSK_<:ecu:>_<:n:>    <:msk:%#x:>
+//@}
+
@@ -0,0 +1,53 @@
+/**
+ * The number of acceptance filters planned for ECU <:ecu:>.
+ *
+ * The filters accept IDs not received by this ECU, use the
+ * RXSTD_<:ecu:> and RXEXT_<:ecu:> lists with hsk_can_filter_accept() to
+ * reject them in software.
+ *<?inexact?>
+ * @ingroup ECU_<:ecu:>
+ */
+#define FILTERS_<:ecu:>         <:filters:>
+
+/**
+ * The sorted list of standard message IDs received by ECU <:ecu:>.
+ *
+ * Use it to initialise a code array of \c ulong values.
+ *<?nostd?>
+ * The ECU does not receive any, the list holds a placeholder that does<?nostd?>
+ * not match any ID.<?nostd?>
+ *
+ * @ingroup ECU_<:ecu:>
+ */
+#define RXSTD_<:ecu:>           \
+	<:std:%#x:>, \
+	0xffffffff, \<?nostd?>
+
+/**
+ * The number of entries in RXSTD_<:ecu:>.
+ *
+ * @ingroup ECU_<:ecu:>
+ */
+#define RXSTDCNT_<:ecu:>        <:stdcnt:>
+
+/**
+ * The sorted list of extended message IDs received by ECU <:ecu:>.
+ *
+ * Use it to initialise a code array of \c ulong values.
+ *<?noext?>
+ * The ECU does not receive any, the list holds a placeholder that does<?noext?>
+ * not match any ID.<?noext?>
+ *
+ * @ingroup ECU_<:ecu:>
+ */
+#define RXEXT_<:ecu:>           \
+	<:ext:%#x:>, \
+	0xffffffff, \<?noext?>
+
+/**
+ * The number of entries in RXEXT_<:ecu:>.
+ *
+ * @ingroup ECU_<:ecu:>
+ */
+#define RXEXTCNT_<:ecu:>        <:extcnt:>
+
@@ -32,14 +32,17 @@
 /**
  * Get signal <:name:> from buffer.
  *
+ * All shifts, masks and byte offsets are constant, the result has the
+ * narrowest type containing the signal.
+ *
  * @param buf
  *	The can message buffer containing the signal
  * @return
  *	The raw signal
  */
-#define GET_<:id:>(buf) (0 \
+#define GET_<:id:>(buf) ((<:type:>)(0 \
 	<:getbuf:> \
-)
+))
 
 /**
  * Set signal <:name:> in buffer.
@@ -1,4 +1,7 @@
-buf[<:byte:>] &= ~(<:msk:%#04x:> << <:align:>);
-<?int8?>buf[<:byte:>] |= (((ubyte)(val) >> <:pos:>) & <:msk:%#04x:>) << <:align:>;
-<?int16?>buf[<:byte:>] |= ((ubyte)((uword)(val) >> <:pos:>) & <:msk:%#04x:>) << <:align:>;
-<?int32?>buf[<:byte:>] |= ((ubyte)((ulong)(val) >> <:pos:>) & <:msk:%#04x:>) << <:align:>;
+<?part?>buf[<:byte:>] &= ~(<:msk:%#04x:> << <:align:>);
+<?part?><?int8?>buf[<:byte:>] |= (((ubyte)(val) >> <:pos:>) & <:msk:%#04x:>) << <:align:>;
+<?part?><?int16?>buf[<:byte:>] |= ((ubyte)((uword)(val) >> <:pos:>) & <:msk:%#04x:>) << <:align:>;
+<?part?><?int32?>buf[<:byte:>] |= ((ubyte)((ulong)(val) >> <:pos:>) & <:msk:%#04x:>) << <:align:>;
+<?full?><?int8?>buf[<:byte:>] = (ubyte)(val);
+<?full?><?int16?>buf[<:byte:>] = (ubyte)((uword)(val) >> <:pos:>);
+<?full?><?int32?>buf[<:byte:>] = (ubyte)((ulong)(val) >> <:pos:>);
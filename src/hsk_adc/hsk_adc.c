@@ -20,6 +20,22 @@
 
 #include "../hsk_isr/hsk_isr.h"
 
+/*
+ * SDCC does not like the code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
 /**
  * Conversion clock prescaler setting for 12MHz.
  */
@@ -54,7 +70,27 @@
 /**
  * Holds the channel of the next conversion that will be requested.
  */
-static hsk_adc_channel pdata nextChannel = ADC_CHANNELS;
+static volatile hsk_adc_channel pdata nextChannel = ADC_CHANNELS;
+
+/** \var scan
+ * Oversampling state for the scan mode.
+ */
+static struct {
+	/**
+	 * The accumulated conversion results of each channel.
+	 */
+	uword sums[ADC_CHANNELS];
+
+	/**
+	 * The number of accumulated results for each channel.
+	 */
+	ubyte counts[ADC_CHANNELS];
+
+	/**
+	 * The oversampling exponent.
+	 */
+	ubyte shift;
+} pdata scan;
 
 /** \var targets
  * An array of target addresses to write conversion results into.
@@ -71,6 +107,21 @@ static volatile union {
 	ubyte * ptr8;
 } pdata targets[ADC_CHANNELS];
 
+/** \var filters
+ * An array of filter functions to pass conversion results through.
+ */
+static volatile struct {
+	/**
+	 * The filter update function.
+	 */
+	void (code *update)(const uword value) using(1);
+
+	/**
+	 * The filter result.
+	 */
+	const uword xdata * result;
+} pdata filters[ADC_CHANNELS];
+
 /**
  * ADC_RESRxL Channel Number bits.
  */
@@ -116,6 +167,10 @@ void hsk_adc_isr10(void) using 1 {
 	SFR_PAGE(_ad2, RST1);
 
 	/* Deliver result to the target address. */
+	if (filters[channel].update) {
+		filters[channel].update(result);
+		result = *filters[channel].result;
+	}
 	if (targets[channel].ptr10) {
 		/* Get the result bits and deliver them. */
 		*targets[channel].ptr10 = result;
@@ -138,11 +193,106 @@ void hsk_adc_isr8(void) using 1 {
 	SFR_PAGE(_ad2, RST1);
 
 	/* Deliver result to the target address. */
+	if (filters[channel].update) {
+		filters[channel].update(result);
+		result = *filters[channel].result;
+	}
 	if (targets[channel].ptr8) {
 		/* Get the result bits and deliver them. */
 		*targets[channel].ptr8 = result;
 	}
 }
+
+/**
+ * ADC_QINR0 Request Channel Number bits.
+ */
+#define BIT_REQCHNR            0
+
+/**
+ * REQCHNR bit count.
+ */
+#define CNT_REQCHNR            3
+
+/**
+ * Requests a conversion of the next channel from the ISR.
+ *
+ * The ADC register page has to be saved in SST1, because it is changed
+ * to page 6.
+ */
+#define ADC_SCAN_REQUEST() { \
+	SFR_PAGE(_ad6, noSST); \
+	if (nextChannel < ADC_CHANNELS) { \
+		ADC_QINR0 = nextChannel << BIT_REQCHNR; \
+		while (!targets[++nextChannel % ADC_CHANNELS].ptr10); \
+		nextChannel %= ADC_CHANNELS; \
+	} \
+}
+
+/**
+ * Accumulate the 10bit conversion result and request the next conversion.
+ *
+ * @private
+ */
+void hsk_adc_isr10_scan(void) using 1 {
+	hsk_adc_channel idata channel;
+	uword idata result;
+
+	/* Read the result. */
+	SFR_PAGE(_ad2, SST1);
+	channel = (ADC_RESR0L >> BIT_CHNR) & ((1 << CNT_CHNR) - 1);
+	result = (ADC_RESR0LH >> BIT_RESULT) & ((1 << CNT_RESULT) - 1);
+	/* Keep the queue filled. */
+	ADC_SCAN_REQUEST();
+	SFR_PAGE(_ad6, RST1);
+
+	/* Accumulate and deliver the average. */
+	scan.sums[channel] += result;
+	if (++scan.counts[channel] >> scan.shift) {
+		result = scan.sums[channel] >> scan.shift;
+		if (filters[channel].update) {
+			filters[channel].update(result);
+			result = *filters[channel].result;
+		}
+		if (targets[channel].ptr10) {
+			*targets[channel].ptr10 = result;
+		}
+		scan.sums[channel] = 0;
+		scan.counts[channel] = 0;
+	}
+}
+
+/**
+ * Accumulate the 8bit conversion result and request the next conversion.
+ *
+ * @private
+ */
+void hsk_adc_isr8_scan(void) using 1 {
+	hsk_adc_channel idata channel;
+	ubyte idata result;
+
+	/* Read the result. */
+	SFR_PAGE(_ad2, SST1);
+	channel = (ADC_RESR0L >> BIT_CHNR) & ((1 << CNT_CHNR) - 1);
+	result = ADC_RESR0H;
+	/* Keep the queue filled. */
+	ADC_SCAN_REQUEST();
+	SFR_PAGE(_ad6, RST1);
+
+	/* Accumulate and deliver the average. */
+	scan.sums[channel] += result;
+	if (++scan.counts[channel] >> scan.shift) {
+		result = scan.sums[channel] >> scan.shift;
+		if (filters[channel].update) {
+			filters[channel].update(result);
+			result = *filters[channel].result;
+		}
+		if (targets[channel].ptr8) {
+			*targets[channel].ptr8 = result;
+		}
+		scan.sums[channel] = 0;
+		scan.counts[channel] = 0;
+	}
+}
 #pragma restore
 
 /**
@@ -201,8 +351,9 @@ void hsk_adc_init(ubyte resolution, uword __xdata convTime) {
 	/* The Sample Time Control bits, values from 0 to 255. */
 	uword stc;
 
-	/* Make sure the conversion target list is clean. */
+	/* Make sure the conversion target and filter lists are clean. */
 	memset(targets, 0, sizeof(targets));
+	memset(filters, 0, sizeof(filters));
 
 	/* Set ADC resolution */
 	SFR_PAGE(_ad0, noSST);
@@ -335,13 +486,17 @@ void hsk_adc_open10(const hsk_adc_channel channel,
 	EADC = 0;
 	/* Register callback function. */
 	targets[channel].ptr10 = target;
-	EADC = eadc;
 
 	/* Check if there are no open channels. */
 	if (nextChannel >= ADC_CHANNELS) {
 		/* Claim the spot as the first open channel. */
 		nextChannel = channel;
+		/* A scan without open channels has stopped, restart it. */
+		if (hsk_isr6.ADCSR0 == &hsk_adc_isr10_scan) {
+			while (hsk_adc_service());
+		}
 	}
+	EADC = eadc;
 }
 
 void hsk_adc_open8(const hsk_adc_channel channel,
@@ -360,44 +515,53 @@ void hsk_adc_open8(const hsk_adc_channel channel,
 	EADC = 0;
 	/* Register callback function. */
 	targets[channel].ptr8 = target;
-	EADC = eadc;
 
 	/* Check if there are no open channels. */
 	if (nextChannel >= ADC_CHANNELS) {
 		/* Claim the spot as the first open channel. */
 		nextChannel = channel;
+		/* A scan without open channels has stopped, restart it. */
+		if (hsk_isr6.ADCSR0 == &hsk_adc_isr8_scan) {
+			while (hsk_adc_service());
+		}
 	}
+	EADC = eadc;
+}
+
+void hsk_adc_filter(const hsk_adc_channel channel,
+		const void (code * const __xdata filter)
+		           (const uword value) using(1),
+		const uword xdata * const result) {
+	bool eadc = EADC;
+	EADC = 0;
+	filters[channel].update = filter;
+	filters[channel].result = result;
+	EADC = eadc;
 }
 
 void hsk_adc_close(const hsk_adc_channel channel) {
 	bool eadc = EADC;
+	/* The scan mode ISR also moves nextChannel. */
 	EADC = 0;
 	/* Unregister conversion target address. */
 	targets[channel].ptr10 = 0;
-	EADC = eadc;
+	/* Drop the samples accumulated in scan mode. */
+	scan.sums[channel] = 0;
+	scan.counts[channel] = 0;
 	/* If this channel is scheduled for the next conversion, find an
 	 * alternative. */
 	if (nextChannel == channel) {
 		/* Get next channel. */
-		for (; nextChannel < channel + ADC_CHANNELS && !targets[nextChannel].ptr10; nextChannel++);
+		for (; nextChannel < channel + ADC_CHANNELS && !targets[nextChannel % ADC_CHANNELS].ptr10; nextChannel++);
 		nextChannel %= ADC_CHANNELS;
 		/* Check whether no active channel was found. */
 		if (!targets[nextChannel].ptr10) {
 			nextChannel = ADC_CHANNELS;
 		}
 	}
+	EADC = eadc;
 }
 
-/**
- * ADC_QINR0 Request Channel Number bits.
- */
-#define BIT_REQCHNR            0
-
-/**
- * REQCHNR bit count.
- */
-#define CNT_REQCHNR            3
-
 bool hsk_adc_service(void) {
 	/* Check for available channels. */
 	if (nextChannel >= ADC_CHANNELS) {
@@ -423,6 +587,29 @@ bool hsk_adc_request(const hsk_adc_channel channel) {
 	return 1;
 }
 
+void hsk_adc_scan(ubyte shift) {
+	EADC = 0;
+
+	/* Start accumulating from scratch. */
+	memset(&scan, 0, sizeof(scan));
+
+	/* Select the ISR for the current resolution. */
+	SFR_PAGE(_ad0, noSST);
+	if (((ADC_GLOBCTR >> BIT_DW) & 1) == ADC_RESOLUTION_10) {
+		scan.shift = shift > ADC_SCAN_MAX10 ? ADC_SCAN_MAX10 : shift;
+		hsk_isr6.ADCSR0 = &hsk_adc_isr10_scan;
+	} else {
+		scan.shift = shift > ADC_SCAN_MAX8 ? ADC_SCAN_MAX8 : shift;
+		hsk_isr6.ADCSR0 = &hsk_adc_isr8_scan;
+	}
+	SFR_PAGE(_ad6, noSST);
+
+	/* Fill the queue, the ISR takes over from here. */
+	while (hsk_adc_service());
+
+	EADC = 1;
+}
+
 #pragma save
 #ifdef SDCC
 #pragma nooverlay
@@ -21,6 +21,9 @@
  * Alternatively hsk_adc_request() can be used to request single just in time
  * conversions.
  *
+ * Or hsk_adc_scan() can be used to let the ISR keep the conversions
+ * going, without calling hsk_adc_service().
+ *
  * @author kami
  */
 
@@ -34,6 +37,21 @@
 #include "../hsk_isr/hsk_isr.isr"
 #endif /* SDCC */
 
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/*
+ * SDCC does not like the \c code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
 
 /**
  * 10 bit ADC resolution.
@@ -111,6 +129,45 @@ void hsk_adc_open10(const hsk_adc_channel channel,
 void hsk_adc_open8(const hsk_adc_channel channel,
 	ubyte * const target);
 
+/**
+ * Pass the conversion results of a channel through a filter.
+ *
+ * The filter is called by the ISR with every conversion result (or
+ * every oversampled result in scan mode). The filter stores its result,
+ * which is delivered to the target address instead, so the target
+ * always holds the filtered value. Filters created with
+ * \ref FILTER_ISR_FACTORY or \ref FILTER_POW2_ISR_FACTORY and a \c uword
+ * value type can directly be used:
+ * \code
+ * #pragma save
+ * #ifdef SDCC
+ * #pragma nooverlay
+ * #endif
+ * FILTER_POW2_ISR_FACTORY(filter7, uword, uword, ubyte, 4)
+ * #pragma restore
+ *
+ * ...
+ * filter7_init();
+ * hsk_adc_open10(7, &adc7);
+ * hsk_adc_filter(7, &filter7_update, &filter7.average);
+ * \endcode
+ *
+ * In 8 bit mode the filter result is truncated to 8 bits.
+ *
+ * Filters are reset by hsk_adc_init().
+ *
+ * @param channel
+ *	The channel id
+ * @param filter
+ *	The filter update function, 0 to remove the filter
+ * @param result
+ *	The location the filter stores its result in
+ */
+void hsk_adc_filter(const hsk_adc_channel channel,
+                    const void (code * const __xdata filter)
+                               (const uword value) using(1),
+                    const uword xdata * const result);
+
 /**
  * Close the given ADC channel.
  *
@@ -154,6 +211,47 @@ bool hsk_adc_service(void);
  */
 bool hsk_adc_request(const hsk_adc_channel channel);
 
+/**
+ * The largest oversampling exponent in 10 bit mode.
+ */
+#define ADC_SCAN_MAX10       6
+
+/**
+ * The largest oversampling exponent in 8 bit mode.
+ *
+ * Limited by the 8 bit result counters, which have to reach
+ * \f$2^{shift}\f$.
+ */
+#define ADC_SCAN_MAX8        7
+
+/**
+ * Switch to autonomous scan mode.
+ *
+ * In scan mode the ISR requests a new conversion for every conversion
+ * result, so the queue is kept filled and hsk_adc_service() must not
+ * be called any more. The open channels are converted one after another.
+ * Channels can be opened and closed at any time, opening a channel while
+ * no channel is open restarts the conversions. Closing a channel drops
+ * its accumulated samples.
+ *
+ * Every channel accumulates \f$2^{shift}\f$ conversion results, before
+ * the average is delivered to the target address. This reduces noise
+ * at no additional cost to the main loop. Note that the update rate
+ * of a target drops with the number of open channels and the
+ * oversampling factor.
+ *
+ * Make sure the conversion time set by hsk_adc_init() leaves enough
+ * time between interrupts, conversions will keep coming back to back.
+ *
+ * Scan mode ends with the next call of hsk_adc_init(). Call
+ * hsk_adc_warmup10() before entering scan mode, it replaces the ISR.
+ *
+ * @param shift
+ *	The oversampling exponent, at most ADC_SCAN_MAX10 in 10 bit mode or
+ *	ADC_SCAN_MAX8 in 8 bit mode, larger values are reduced
+ */
+void hsk_adc_scan(ubyte shift);
+
 /**
  * Backwards compatibility hack.
  *
@@ -177,4 +275,19 @@ bool hsk_adc_request(const hsk_adc_channel channel);
  */
 void hsk_adc_warmup10(void);
 
+/*
+ * Restore the usual meaning of \c code.
+ */
+#ifdef SDCC
+	#undef code
+	#define code	__code
+#endif
+
+/*
+ * Restore the usual meaning of \c using(bank).
+ */
+#ifdef __C51__
+	#undef using
+#endif /* __C51__ */
+
 #endif /* _HSK_ADC_H_ */
@@ -56,6 +56,17 @@
 
 #include <string.h> /* memset() */
 
+#include "../hsk_isr/hsk_isr.h"
+
+/*
+ * SDCC does not like the code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
 /**
  * CAN_ADCON Read/Write Enable bit.
  *
@@ -257,6 +268,21 @@
  */
 #define BIT_DIV8               15
 
+/**
+ * NFCRx CAN Frame Count Mode bits in byte 2.
+ */
+#define BIT_CFMOD              3
+
+/**
+ * CFMOD bit count.
+ */
+#define CNT_CFMOD              2
+
+/**
+ * Frame counter time stamp mode, counts CAN bit times.
+ */
+#define CFMOD_TIMESTAMP        1
+
 /**
  * NPCRx Receive Select bit.
  */
@@ -394,6 +420,52 @@ static bool initialised = 0;
  */
 #define BIT_CAN_DIS            5
 
+/** \file
+ * \section mon Timeout Monitoring
+ *
+ * The monitor keeps the tick of the last reception for every entry. The
+ * timer tick only ever looks at a single entry and is the only writer
+ * of the timeout bitmap, so the bitmap needs no locking.
+ *
+ * Timeouts are compared with the difference between the current and the
+ * last reception tick, so the 16 bit tick counter may overflow freely.
+ */
+
+/** \var mon
+ * Timeout monitor state.
+ */
+static struct {
+	/**
+	 * The tick counter.
+	 */
+	volatile uword now;
+
+	/**
+	 * The tick of the last reception for each entry.
+	 */
+	volatile uword last[CAN_MON_MAX];
+
+	/**
+	 * The timeout for each entry, 0 for unused entries.
+	 */
+	uword timeout[CAN_MON_MAX];
+
+	/**
+	 * The monitor entry of each message object, CAN_ERROR if unmonitored.
+	 */
+	ubyte entry[HSK_CAN_MSG_MAX];
+
+	/**
+	 * The entry to check with the next tick.
+	 */
+	ubyte scan;
+
+	/**
+	 * The timeout bitmap.
+	 */
+	volatile uword timeouts;
+} xdata mon;
+
 void hsk_can_init(const ubyte pins, const ulong __xdata baud) {
 	/* The node to configure. */
 	hsk_can_node node;
@@ -422,6 +494,9 @@ void hsk_can_init(const ubyte pins, const ulong __xdata baud) {
 		 */
 		CAN_ADLH = PANCTR;
 		PANCTR_READY();
+
+		/* No message objects are monitored for timeouts. */
+		memset(mon.entry, CAN_ERROR, sizeof(mon.entry));
 	}
 
 	/*
@@ -495,6 +570,16 @@ void hsk_can_init(const ubyte pins, const ulong __xdata baud) {
 		| ((48000000 / 12 / baud - 1) << BIT_BRP);
 	CAN_AD_WRITE(0x3);
 
+	/*
+	 * Run the frame counter in time stamp mode, it is captured upon
+	 * reception and used to time stamp interrupt driven reception.
+	 */
+	CAN_ADLH = NFCRx + (node << OFF_NODEx);
+	CAN_AD_READ();
+	CAN_DATA2 = CAN_DATA2 & ~(((1 << CNT_CFMOD) - 1) << BIT_CFMOD) \
+		| (CFMOD_TIMESTAMP << BIT_CFMOD);
+	CAN_AD_WRITE(0x4);
+
 	/**
 	 * <b>I/O Configuration</b>
 	 *
@@ -655,6 +740,11 @@ ubyte hsk_can_status(const hsk_can_node node, const ubyte field) {
  */
 #define MOFGPRn                0x0401
 
+/**
+ * Message Object n Interrupt Pointer Register base address.
+ */
+#define MOIPRn                 0x0402
+
 /**
  * Message Object n Acceptance Mask Register base address.
  */
@@ -866,6 +956,74 @@ ubyte hsk_can_status(const hsk_can_node node, const ubyte field) {
  */
 #define PRI_ID                 2
 
+/**
+ * Shadow table flag for extended CAN IDs.
+ */
+#define OBJ_EXTENDED           0x01
+
+/**
+ * Shadow table flag for message objects in TX mode.
+ *
+ * Lets hsk_can_msg_receive() skip objects that are in RX mode already.
+ */
+#define OBJ_TX                 0x02
+
+/**
+ * Shadow table flag for FIFO base objects.
+ */
+#define OBJ_FIFO               0x04
+
+/**
+ * Shadow table flag for objects accepting more than one ID.
+ */
+#define OBJ_MASKED             0x08
+
+/** \var objects
+ * Software copies of the message object configuration.
+ *
+ * This saves reading back configuration from the MultiCAN module in
+ * frequently used functions. All functions of this library writing the
+ * configuration also update the shadow table. After changing the
+ * configuration behind the back of the library hsk_can_resync() must be
+ * called.
+ */
+static struct {
+	/**
+	 * The configured CAN ID.
+	 */
+	ulong id;
+
+	/**
+	 * The data length code used for transmission.
+	 */
+	ubyte dlc;
+
+	/**
+	 * The OBJ_* flags.
+	 */
+	ubyte flags;
+
+	/**
+	 * The next message object in the list, used to walk FIFOs.
+	 */
+	ubyte next;
+
+	/**
+	 * The bottom object of a FIFO base.
+	 */
+	ubyte bot;
+
+	/**
+	 * The top object of a FIFO base.
+	 */
+	ubyte top;
+
+	/**
+	 * The currently selected object of a FIFO base.
+	 */
+	ubyte sel;
+} xdata objects[HSK_CAN_MSG_MAX];
+
 hsk_can_msg hsk_can_msg_create(const ulong id, const bool extended,
 		const ubyte dlc) {
 	hsk_can_msg msg;
@@ -890,8 +1048,11 @@ hsk_can_msg hsk_can_msg_create(const ulong id, const bool extended,
 	/*
 	 * Set the DLC and message mode.
 	 */
+	objects[msg].dlc = dlc <= 8 ? dlc : 8;
+	objects[msg].id = id;
+	objects[msg].flags = extended ? OBJ_EXTENDED : 0;
 	CAN_ADLH = MOFCRn + (msg << OFF_MOn);
-	CAN_DATA3 = (dlc <= 8 ? dlc : 8) << BIT_DLC;
+	CAN_DATA3 = objects[msg].dlc << BIT_DLC;
 	CAN_DATA0 = MMC_DEFAULT << BIT_MMC;
 	CAN_AD_WRITE(0x9);
 
@@ -1000,14 +1161,106 @@ ubyte hsk_can_msg_disconnect(const hsk_can_msg msg) {
 }
 
 ubyte hsk_can_msg_delete(const hsk_can_msg msg) {
+	/* Stop timeout monitoring. */
+	hsk_can_mon_unregister(msg);
+
 	/* Move the message object into the list of unallocated objects. */
 	return hsk_can_msg_move(msg, LIST_UNALLOC);
 }
 
+/**
+ * Reads data from the selected message object.
+ *
+ * Only execute this if CAN_ADLH points to MODATALn.
+ *
+ * @param msgdata
+ *	The character array to store the message data in
+ * @param dlc
+ *	The number of bytes to read
+ * @private
+ */
+void hsk_can_msg_readData(ubyte * const msgdata, const ubyte dlc) {
+	/* Get the low data word. */
+	CAN_AD_READ() | AUAD_INC1;
+	switch (dlc) {
+	default:
+	case 4:
+		msgdata[3] = CAN_DATA3;
+	case 3:
+		msgdata[2] = CAN_DATA2;
+	case 2:
+		msgdata[1] = CAN_DATA1;
+	case 1:
+		msgdata[0] = CAN_DATA0;
+	case 0:
+		break;
+	}
+	if (dlc <= 4) {
+		return;
+	}
+
+	/* Get the high data word. */
+	CAN_AD_READ();
+	switch (dlc) {
+	case 8:
+		msgdata[7] = CAN_DATA3;
+	case 7:
+		msgdata[6] = CAN_DATA2;
+	case 6:
+		msgdata[5] = CAN_DATA1;
+	case 5:
+		msgdata[4] = CAN_DATA0;
+	}
+}
+
+/**
+ * Writes data into the selected message object.
+ *
+ * Only execute this if CAN_ADLH points to MODATALn.
+ *
+ * @param msgdata
+ *	The character array to get the message data from
+ * @param dlc
+ *	The number of bytes to write
+ * @private
+ */
+void hsk_can_msg_writeData(const ubyte * const msgdata, const ubyte dlc) {
+	/* Set the low data word. */
+	switch (dlc) {
+	default:
+	case 4:
+		CAN_DATA3 = msgdata[3];
+	case 3:
+		CAN_DATA2 = msgdata[2];
+	case 2:
+		CAN_DATA1 = msgdata[1];
+	case 1:
+		CAN_DATA0 = msgdata[0];
+	case 0:
+		break;
+	}
+	CAN_AD_WRITE((1 << (dlc < 4 ? dlc : 4)) - 1) | AUAD_INC1;
+	if (dlc <= 4) {
+		return;
+	}
+
+	/* Set the high data word. */
+	switch (dlc) {
+	case 8:
+		CAN_DATA3 = msgdata[7];
+	case 7:
+		CAN_DATA2 = msgdata[6];
+	case 6:
+		CAN_DATA1 = msgdata[5];
+	case 5:
+		CAN_DATA0 = msgdata[4];
+	}
+	CAN_AD_WRITE((1 << (dlc - 4)) - 1);
+}
+
 void hsk_can_msg_getData(const hsk_can_msg msg,
 		ubyte * const msgdata) {
-	ubyte dlc, i;
-
+	ubyte dlc;
 
 	/* Select message status/control. */
 	CAN_ADLH = MOSTATn + (msg << OFF_MOn);
@@ -1015,30 +1268,14 @@ void hsk_can_msg_getData(const hsk_can_msg msg,
 		/* Reset the new data bit. */
 		CAN_DATA0 = 1 << BIT_NEWDAT;
 		CAN_AD_WRITE(0x1);
-		
-		/* Get the DLC. */
+
+		/* Get the DLC, it is updated upon reception. */
 		CAN_ADLH = MOFCRn + (msg << OFF_MOn);
 		CAN_AD_READ();
 		dlc = (CAN_DATA3 >> BIT_DLC) & ((1 << CNT_DLC) - 1);
-	
+
 		CAN_ADLH = MODATALn + (msg << OFF_MOn);
-		for (i = 0; i < dlc; i++) {
-			switch (i % 4) {
-			case 0:
-				CAN_AD_READ() | AUAD_INC1;
-				msgdata[i] = CAN_DATA0;
-				break;
-			case 1:
-				msgdata[i] = CAN_DATA1;
-				break;
-			case 2:
-				msgdata[i] = CAN_DATA2;
-				break;
-			case 3:
-				msgdata[i] = CAN_DATA3;
-				break;
-			}
-		}
+		hsk_can_msg_readData(msgdata, dlc);
 
 		/* Load message status. */
 		CAN_ADLH = MOSTATn + (msg << OFF_MOn);
@@ -1049,37 +1286,62 @@ void hsk_can_msg_getData(const hsk_can_msg msg,
 
 void hsk_can_msg_setData(const hsk_can_msg msg,
 		const ubyte * const msgdata) {
-	ubyte dlc, i;
+	CAN_ADLH = MODATALn + (msg << OFF_MOn);
+	hsk_can_msg_writeData(msgdata, objects[msg].dlc);
+}
 
-	/* Get the DLC. */
-	CAN_ADLH = MOFCRn + (msg << OFF_MOn);
-	CAN_AD_READ();
-	dlc = (CAN_DATA3 >> BIT_DLC) & ((1 << CNT_DLC) - 1);
+ulong hsk_can_msg_getSignal(const hsk_can_msg msg, const bool motorola,
+		const bool sign, const ubyte bitPos,
+		const char bitCount) {
+	ubyte msgdata[8];
+	ubyte first, last;
 
-	CAN_ADLH = MODATALn + (msg << OFF_MOn);
-	for (i = 0; i < dlc; i++) {
-		switch (i % 4) {
-		case 0:
-			CAN_DATA0 = msgdata[i];
-			break;
-		case 1:
-			CAN_DATA1 = msgdata[i];
-			break;
-		case 2:
-			CAN_DATA2 = msgdata[i];
-			break;
-		case 3:
-			CAN_DATA3 = msgdata[i];
-			CAN_AD_WRITE(0xf) | AUAD_INC1;
-			break;
-		}
-	}
-	if (i % 4) {
-		CAN_AD_WRITE((1 << (i % 4)) - 1);
+	/* Get the first and the last byte of the signal. */
+	first = bitPos / 8;
+	if (motorola) {
+		last = first + (bitCount - (bitPos % 8) + 6) / 8;
+	} else {
+		last = (bitPos + bitCount - 1) / 8;
 	}
+
+	/* Select message status/control. */
+	CAN_ADLH = MOSTATn + (msg << OFF_MOn);
+	do {
+		/* Reset the new data bit. */
+		CAN_DATA0 = 1 << BIT_NEWDAT;
+		CAN_AD_WRITE(0x1);
+
+		/* Only fetch the data words containing the signal. */
+		if (first < 4) {
+			CAN_ADLH = MODATALn + (msg << OFF_MOn);
+			CAN_AD_READ() | AUAD_INC1;
+			msgdata[0] = CAN_DATA0;
+			msgdata[1] = CAN_DATA1;
+			msgdata[2] = CAN_DATA2;
+			msgdata[3] = CAN_DATA3;
+		} else {
+			CAN_ADLH = MODATAHn + (msg << OFF_MOn);
+		}
+		if (last >= 4) {
+			CAN_AD_READ();
+			msgdata[4] = CAN_DATA0;
+			msgdata[5] = CAN_DATA1;
+			msgdata[6] = CAN_DATA2;
+			msgdata[7] = CAN_DATA3;
+		}
+
+		/* Load message status. */
+		CAN_ADLH = MOSTATn + (msg << OFF_MOn);
+		CAN_AD_READ();
+		/* Retry if the message was updated in between. */
+	} while (CAN_DATA0 & ((1 << BIT_NEWDAT) | (1 << BIT_RXUPD)));
+
+	return hsk_can_data_getSignal(msgdata, motorola, sign, bitPos, bitCount);
 }
 
 void hsk_can_msg_send(const hsk_can_msg msg) {
+	objects[msg].flags |= OBJ_TX;
+
 	/* Request transmission. */
 	CAN_ADLH = MOCTRn + (msg << OFF_MOn);
 	SET_DATA = (1 << BIT_TXEN0) | (1 << BIT_TXEN1) | (1 << BIT_TXRQ) | (1 << BIT_DIR);
@@ -1104,6 +1366,12 @@ bool hsk_can_msg_sent(const hsk_can_msg msg) {
 }
 
 void hsk_can_msg_receive(const hsk_can_msg msg) {
+	/* Already in RX mode. */
+	if (!(objects[msg].flags & OBJ_TX)) {
+		return;
+	}
+	objects[msg].flags &= ~OBJ_TX;
+
 	/* Return to rx mode. */
 	CAN_ADLH = MOCTRn + (msg << OFF_MOn);
 	SET_DATA = (1 << BIT_RXEN);
@@ -1127,6 +1395,103 @@ bool hsk_can_msg_updated(const hsk_can_msg msg) {
 	return 1;
 }
 
+void hsk_can_resync(void) {
+	hsk_can_msg msg;
+	ulong msk;
+
+	for (msg = 0; msg < HSK_CAN_MSG_MAX; msg++) {
+		#define obj    objects[msg]
+		/* Get the DLC and message mode, followed by MOFGPRn. */
+		CAN_ADLH = MOFCRn + (msg << OFF_MOn);
+		CAN_AD_READ() | AUAD_INC1;
+		obj.dlc = (CAN_DATA3 >> BIT_DLC) & ((1 << CNT_DLC) - 1);
+		switch ((CAN_DATA0 >> BIT_MMC) & ((1 << CNT_MMC) - 1)) {
+		case MMC_RXBASEFIFO:
+		case MMC_TXBASEFIFO:
+			obj.flags = OBJ_FIFO;
+			break;
+		default:
+			obj.flags = 0;
+			break;
+		}
+		CAN_AD_READ();
+		obj.bot = MOFGPRn_BOT;
+		obj.top = MOFGPRn_TOP;
+		obj.sel = MOFGPRn_SEL;
+
+		/* Get the acceptance mask. */
+		CAN_ADLH = MOAMRn + (msg << OFF_MOn);
+		CAN_AD_READ();
+		msk = CAN_DATA23;
+		msk <<= 16;
+		msk |= CAN_DATA01;
+
+		/* Get the ID, followed by MOSTATn. */
+		CAN_ADLH = MOARn + (msg << OFF_MOn);
+		CAN_AD_READ() | AUAD_INC1;
+		#define extended ((CAN_DATA3 >> (BIT_IDE - 24)) & 1)
+		obj.id = CAN_DATA23;
+		obj.id <<= 16;
+		obj.id |= CAN_DATA01;
+		obj.id >>= extended ? BIT_IDEXT : BIT_IDSTD;
+		obj.id &= (1ul << (extended ? CNT_IDEXT : CNT_IDSTD)) - 1;
+		if (extended) {
+			obj.flags |= OBJ_EXTENDED;
+			msk = ~msk & (((1ul << CNT_IDEXT) - 1) << BIT_IDEXT);
+		} else {
+			msk = ~msk & (((1ul << CNT_IDSTD) - 1) << BIT_IDSTD);
+		}
+		#undef extended
+		/* Check for an incomplete acceptance mask. */
+		if (msk) {
+			obj.flags |= OBJ_MASKED;
+		}
+		CAN_AD_READ();
+		if ((CAN_DATA1 >> (BIT_DIR - 8)) & 1) {
+			obj.flags |= OBJ_TX;
+		}
+		obj.next = MOSTATn_PNEXT;
+		#undef obj
+	}
+}
+
+void hsk_can_batch_getData(const hsk_can_msg * const msgs,
+		ubyte * const msgdata, const ubyte count) {
+	ubyte i;
+
+	for (i = 0; i < count; i++) {
+		hsk_can_msg_getData(msgs[i], msgdata + (i << 3));
+	}
+}
+
+void hsk_can_batch_setData(const hsk_can_msg * const msgs,
+		const ubyte * const msgdata, const ubyte count) {
+	ubyte i;
+
+	for (i = 0; i < count; i++) {
+		CAN_ADLH = MODATALn + (msgs[i] << OFF_MOn);
+		hsk_can_msg_writeData(msgdata + (i << 3), objects[msgs[i]].dlc);
+	}
+}
+
+void hsk_can_batch_send(const hsk_can_msg * const msgs,
+		const ubyte * const msgdata, const ubyte count) {
+	ubyte i;
+
+	for (i = 0; i < count; i++) {
+		/* Set the data. */
+		CAN_ADLH = MODATALn + (msgs[i] << OFF_MOn);
+		hsk_can_msg_writeData(msgdata + (i << 3), objects[msgs[i]].dlc);
+
+		/* Request transmission. */
+		objects[msgs[i]].flags |= OBJ_TX;
+		CAN_ADLH = MOCTRn + (msgs[i] << OFF_MOn);
+		SET_DATA = (1 << BIT_TXEN0) | (1 << BIT_TXEN1) | (1 << BIT_TXRQ) | (1 << BIT_DIR);
+		RESET_DATA = (1 << BIT_RXEN);
+		CAN_AD_WRITE(0xF);
+	}
+}
+
 hsk_can_fifo hsk_can_fifo_create(ubyte size) {
 	hsk_can_fifo base;
 	hsk_can_msg top;
@@ -1173,7 +1538,9 @@ hsk_can_fifo hsk_can_fifo_create(ubyte size) {
 		if (PANAR2 & (1 << BIT_ERR)) {
 			break;
 		}
+		objects[top].next = PANAR1;
 		top = PANAR1;
+		objects[top].flags = 0;
 
 		/* Set message mode to TXSLAVE. */
 		CAN_ADLH = MOFCRn + (top << OFF_MOn);
@@ -1203,6 +1570,10 @@ hsk_can_fifo hsk_can_fifo_create(ubyte size) {
 	 * the list boundaries. SEL will be used to keep track of where to
 	 * read/write the next message when interacting with the FIFO.
 	 */
+	objects[base].flags = OBJ_FIFO;
+	objects[base].bot = base;
+	objects[base].top = top;
+	objects[base].sel = base;
 	CAN_ADLH = MOFGPRn + (base << OFF_MOn);
 	MOFGPRn_BOT = base;
 	MOFGPRn_CUR = base;
@@ -1231,8 +1602,11 @@ void hsk_can_fifo_setupRx(hsk_can_fifo fifo, const ulong id,
 	/*
 	 * Set the DLC and message mode.
 	 */
+	objects[fifo].dlc = dlc <= 8 ? dlc : 8;
+	objects[fifo].id = id;
+	objects[fifo].flags = OBJ_FIFO | (extended ? OBJ_EXTENDED : 0);
 	CAN_ADLH = MOFCRn + (fifo << OFF_MOn);
-	CAN_DATA3 = (dlc <= 8 ? dlc : 8) << BIT_DLC;
+	CAN_DATA3 = objects[fifo].dlc << BIT_DLC;
 	CAN_DATA0 = MMC_RXBASEFIFO << BIT_MMC;
 	CAN_AD_WRITE(0x9);
 
@@ -1257,17 +1631,11 @@ void hsk_can_fifo_setupRx(hsk_can_fifo fifo, const ulong id,
 	SET_DATA = (1 << BIT_MSGVAL) | (1 << BIT_RXEN);
 	CAN_AD_WRITE(0xF);
 
-	/* Get the FIFO top. */
-	CAN_ADLH = MOFGPRn + (fifo << OFF_MOn);
-	CAN_AD_READ();
-	top = MOFGPRn_TOP;
-
 	/* Set all messages in the FIFO valid. */
+	top = objects[fifo].top;
 	while (fifo != top) {
 		/* Get the next message. */
-		CAN_ADLH = MOSTATn + (fifo << OFF_MOn);
-		CAN_AD_READ();
-		fifo = MOSTATn_PNEXT;
+		fifo = objects[fifo].next;
 
 		/* Set message valid. */
 		CAN_ADLH = MOCTRn + (fifo << OFF_MOn);
@@ -1280,13 +1648,18 @@ void hsk_can_fifo_setupRx(hsk_can_fifo fifo, const ulong id,
 void hsk_can_fifo_setRxMask(const hsk_can_fifo fifo, ulong msk) {
 
 	/* Shift msk into position. */
-	CAN_ADLH = MOARn + (fifo << OFF_MOn);
-	CAN_AD_READ();
-	if ((CAN_DATA3 >> (BIT_IDE - 24)) & 1) {
+	objects[fifo].flags |= OBJ_MASKED;
+	if (objects[fifo].flags & OBJ_EXTENDED) {
 		msk &= (1ul << CNT_IDEXT) - 1;
+		if (msk == (1ul << CNT_IDEXT) - 1) {
+			objects[fifo].flags &= ~OBJ_MASKED;
+		}
 		msk <<= BIT_IDEXT;
 	} else {
 		msk &= (1ul << CNT_IDSTD) - 1;
+		if (msk == (1ul << CNT_IDSTD) - 1) {
+			objects[fifo].flags &= ~OBJ_MASKED;
+		}
 		msk <<= BIT_IDSTD;
 	}
 
@@ -1390,49 +1763,47 @@ ubyte hsk_can_fifo_delete(const hsk_can_fifo fifo) {
 }
 
 void hsk_can_fifo_next(const hsk_can_fifo fifo) {
-
-	/* Get the current selection. */
-	CAN_ADLH = MOFGPRn + (fifo << OFF_MOn);
-	CAN_AD_READ();
+	#define fifo    objects[fifo]
 	/* The top entry is selected start from the bottom. */
-	if (MOFGPRn_SEL == MOFGPRn_TOP) {
-		MOFGPRn_SEL = MOFGPRn_BOT;
-		CAN_AD_WRITE(0x8);
-		return;
+	if (fifo.sel == fifo.top) {
+		fifo.sel = fifo.bot;
+	} else {
+		fifo.sel = objects[fifo.sel].next;
 	}
+	#undef fifo
 
-	/* Get the next message. */
-	CAN_ADLH = MOSTATn + (MOFGPRn_SEL << OFF_MOn);
-	CAN_AD_READ();
-
-	/* Write PNEXT into SEL. */
+	/* Keep the MultiCAN copy up to date. */
 	CAN_ADLH = MOFGPRn + (fifo << OFF_MOn);
-	MOFGPRn_SEL = MOSTATn_PNEXT;
+	MOFGPRn_SEL = objects[fifo].sel;
 	CAN_AD_WRITE(0x8);
 }
 
 bool hsk_can_fifo_updated(const hsk_can_fifo fifo) {
-	/* Get the current selection. */
-	CAN_ADLH = MOFGPRn + (fifo << OFF_MOn);
-	CAN_AD_READ();
-	return hsk_can_msg_updated(MOFGPRn_SEL);
+	return hsk_can_msg_updated(objects[fifo].sel);
 }
 
 void hsk_can_fifo_getData(const hsk_can_fifo fifo,
 		ubyte * const msgdata) {
-	/* Get the current selection. */
-	CAN_ADLH = MOFGPRn + (fifo << OFF_MOn);
-	CAN_AD_READ();
-	hsk_can_msg_getData(MOFGPRn_SEL, msgdata);
+	hsk_can_msg_getData(objects[fifo].sel, msgdata);
+}
+
+ulong hsk_can_fifo_getSignal(const hsk_can_fifo fifo, const bool motorola,
+		const bool sign, const ubyte bitPos,
+		const char bitCount) {
+	return hsk_can_msg_getSignal(objects[fifo].sel, motorola, sign,
+	                             bitPos, bitCount);
 }
 
 ulong hsk_can_fifo_getId(const hsk_can_fifo fifo) {
 	ulong result;
 
-	/* Get the current selection. */
-	CAN_ADLH = MOFGPRn + (fifo << OFF_MOn);
-	CAN_AD_READ();
-	CAN_ADLH = MOARn + (MOFGPRn_SEL << OFF_MOn);
+	/* Without a mask, only the configured ID can be received. */
+	if (!(objects[fifo].flags & OBJ_MASKED)) {
+		return objects[fifo].id;
+	}
+
+	/* The ID of the selected object changes with masked reception. */
+	CAN_ADLH = MOARn + (objects[fifo].sel << OFF_MOn);
 	CAN_AD_READ();
 
 	#define extended ((CAN_DATA3 >> (BIT_IDE - 24)) & 1)
@@ -1445,6 +1816,568 @@ ulong hsk_can_fifo_getId(const hsk_can_fifo fifo) {
 	#undef extended
 }
 
+bool hsk_can_filter_accept(const ulong id, const ulong code * const ids,
+		const ubyte count) {
+	ubyte lo = 0, hi = count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		if (ids[mid] < id) {
+			lo = mid + 1;
+		} else if (ids[mid] > id) {
+			hi = mid;
+		} else {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+void hsk_can_mon_tick(void) using 1 {
+	ubyte i = mon.scan;
+
+	mon.now++;
+	if (mon.timeout[i] && mon.now - mon.last[i] >= mon.timeout[i]) {
+		mon.timeouts |= (uword)1 << i;
+	} else {
+		mon.timeouts &= ~((uword)1 << i);
+	}
+	mon.scan = (i + 1) % CAN_MON_MAX;
+}
+#pragma restore
+
+ubyte hsk_can_mon_register(const hsk_can_msg msg, const uword timeout) {
+	bool ea = EA;
+	ubyte i;
+
+	if (msg >= HSK_CAN_MSG_MAX || !timeout || timeout > 0x7fff) {
+		return CAN_ERROR;
+	}
+	/* Reuse the entry of an already monitored message object. */
+	i = mon.entry[msg];
+	if (i == CAN_ERROR) {
+		for (i = 0; i < CAN_MON_MAX && mon.timeout[i]; i++);
+		if (i >= CAN_MON_MAX) {
+			return CAN_ERROR;
+		}
+	}
+
+	/* Start counting from the current tick. */
+	EA = 0;
+	mon.last[i] = mon.now;
+	mon.timeout[i] = timeout;
+	EA = ea;
+	mon.entry[msg] = i;
+	return i;
+}
+
+ubyte hsk_can_mon_unregister(const hsk_can_msg msg) {
+	bool ea = EA;
+	ubyte i;
+
+	if (msg >= HSK_CAN_MSG_MAX || (i = mon.entry[msg]) == CAN_ERROR) {
+		return CAN_ERROR;
+	}
+	mon.entry[msg] = CAN_ERROR;
+	/* The tick reads the timeout and updates the bitmap. */
+	EA = 0;
+	mon.timeout[i] = 0;
+	mon.timeouts &= ~((uword)1 << i);
+	EA = ea;
+	return 0;
+}
+
+void hsk_can_mon_feed(const hsk_can_msg msg) {
+	bool ea = EA;
+	ubyte i;
+
+	if (msg >= HSK_CAN_MSG_MAX || (i = mon.entry[msg]) == CAN_ERROR) {
+		return;
+	}
+	EA = 0;
+	mon.last[i] = mon.now;
+	EA = ea;
+}
+
+bool hsk_can_mon_timeout(const hsk_can_msg msg) {
+	ubyte i;
+
+	if (msg >= HSK_CAN_MSG_MAX || (i = mon.entry[msg]) == CAN_ERROR) {
+		return 0;
+	}
+	/* Only read the byte containing the bit. */
+	if (i < 8) {
+		return ((ubyte)mon.timeouts >> i) & 1;
+	}
+	return ((ubyte)(mon.timeouts >> 8) >> (i - 8)) & 1;
+}
+
+uword hsk_can_mon_getTimeouts(void) {
+	bool ea = EA;
+	uword timeouts;
+
+	EA = 0;
+	timeouts = mon.timeouts;
+	EA = ea;
+	return timeouts;
+}
+
+/** \file
+ * \section tx Cyclic Transmission
+ *
+ * Every entry has the tick of its next transmission. An entry is due
+ * when the difference between the current tick and that tick is not
+ * negative, which works across overflows of the tick counter, as long
+ * as cycle times stay below 32768 ticks.
+ */
+
+/**
+ * Entry flag, use the fast cycle time.
+ */
+#define TX_FAST                0x01
+
+/**
+ * Entry flag, send with the next run.
+ */
+#define TX_TRIGGER             0x02
+
+/** \var tx
+ * Transmit scheduler state.
+ */
+static struct {
+	/**
+	 * The transmit table.
+	 */
+	const hsk_can_tx_entry * table;
+
+	/**
+	 * The number of table entries.
+	 */
+	ubyte count;
+
+	/**
+	 * The tick of the next transmission for each entry.
+	 */
+	uword due[CAN_TX_MAX];
+
+	/**
+	 * The TX_* flags for each entry.
+	 */
+	ubyte flags[CAN_TX_MAX];
+} xdata tx;
+
+/**
+ * Returns the current tick.
+ *
+ * @return
+ *	The tick counted by hsk_can_mon_tick()
+ * @private
+ */
+uword hsk_can_tx_now(void) {
+	bool ea = EA;
+	uword now;
+
+	EA = 0;
+	now = mon.now;
+	EA = ea;
+	return now;
+}
+
+ubyte hsk_can_tx_init(const hsk_can_tx_entry * const table,
+		const ubyte count) {
+	uword now = hsk_can_tx_now();
+	ubyte i;
+
+	if (count > CAN_TX_MAX) {
+		return CAN_ERROR;
+	}
+	tx.table = table;
+	tx.count = count;
+
+	/* Stagger the first transmissions. */
+	for (i = 0; i < count; i++) {
+		tx.flags[i] = 0;
+		tx.due[i] = now + (uword)((ulong)table[i].cycle * i / count);
+	}
+	return 0;
+}
+
+void hsk_can_tx_run(void) {
+	uword now = hsk_can_tx_now();
+	uword cycle;
+	ubyte i;
+	#define entry tx.table[i]
+
+	for (i = 0; i < tx.count; i++) {
+		cycle = (tx.flags[i] & TX_FAST) && entry.fast ? entry.fast : entry.cycle;
+		if (tx.flags[i] & TX_TRIGGER) {
+			/* Restart the cycle. */
+			tx.flags[i] &= ~TX_TRIGGER;
+			tx.due[i] = now;
+		} else if (!cycle || (int)(now - tx.due[i]) < 0) {
+			continue;
+		}
+
+		hsk_can_msg_setData(entry.msg, entry.buf);
+		hsk_can_msg_send(entry.msg);
+
+		/* Keep the phase, unless a whole cycle was missed. */
+		tx.due[i] += cycle;
+		if ((int)(now - tx.due[i]) >= 0) {
+			tx.due[i] = now + cycle;
+		}
+	}
+	#undef entry
+}
+
+void hsk_can_tx_setFast(const ubyte entry, const bool fast) {
+	if (entry >= tx.count) {
+		return;
+	}
+	if (fast && !(tx.flags[entry] & TX_FAST)) {
+		tx.flags[entry] |= TX_FAST | TX_TRIGGER;
+	} else if (!fast) {
+		tx.flags[entry] &= ~TX_FAST;
+	}
+}
+
+void hsk_can_tx_trigger(const ubyte entry) {
+	if (entry < tx.count) {
+		tx.flags[entry] |= TX_TRIGGER;
+	}
+}
+
+/** \file
+ * \section rx_isr Interrupt Driven Reception
+ *
+ * Message objects connected to the receive ring buffer use their interrupt
+ * pointer register to raise the CANSRC1 interrupt and set their own bit in
+ * the Message Pending Register 0 (the message pending number is set to the
+ * message object id).
+ *
+ * The ISR uses the Message Index Register 0 to find the pending message
+ * objects and fetches each one with a single address setup, using the
+ * auto increment mode to walk from MOFCRn to MOSTATn.
+ *
+ * Because the ISR uses the CAN_AD bus, it preserves the address and data
+ * registers of the interrupted code.
+ *
+ * The frames are allocated from \ref hsk_can_rx_pool, the ring buffer
+ * only holds pointers to them. The pool has one block less than the ring
+ * buffer has entries, so the ring buffer cannot overflow, a frame is
+ * dropped when the pool is exhausted.
+ */
+
+/**
+ * Provides the frames of the receive ring buffer.
+ */
+POOL_FACTORY(hsk_can_rx_pool, sizeof(hsk_can_frame), CAN_RX_BUF_SIZE - 1)
+
+/**
+ * Message Pending Register k base address.
+ */
+#define MSPNDk                 0x0050
+
+/**
+ * Message Index Register k base address.
+ */
+#define MSIDk                  0x0060
+
+/**
+ * Message Index Mask Register address.
+ */
+#define MSIMASK                0x0070
+
+/**
+ * MSIDk Message Pending Index bits.
+ */
+#define BIT_INDEX              0
+
+/**
+ * INDEX bit count.
+ */
+#define CNT_INDEX              6
+
+/**
+ * The INDEX value if no message is pending.
+ */
+#define INDEX_NONE             0x20
+
+/**
+ * MOIPRn Receive Interrupt Node Pointer bits.
+ */
+#define BIT_RXINP              0
+
+/**
+ * RXINP bit count.
+ */
+#define CNT_RXINP              3
+
+/**
+ * The interrupt node used for reception, i.e. CANSRC1.
+ */
+#define RXINP_CANSRC1          1
+
+/**
+ * MOIPRn Message Pending Number byte.
+ */
+#define MOIPRn_MPN             CAN_DATA1
+
+/**
+ * MOIPRn CAN Frame Counter Value word.
+ */
+#define MOIPRn_CFCVAL          CAN_DATA23
+
+/**
+ * MOFCRn Receive Interrupt Enable bit in byte 2.
+ */
+#define BIT_RXIE               0
+
+/** \var rx
+ * The receive ring buffer state.
+ */
+static struct {
+	/**
+	 * The ring buffer, points to frames from \ref hsk_can_rx_pool.
+	 */
+	hsk_can_frame xdata * frames[CAN_RX_BUF_SIZE];
+
+	/**
+	 * The callback functions for every message object.
+	 */
+	void (code * callbacks[HSK_CAN_MSG_MAX])
+	     (const hsk_can_frame __xdata * const frame);
+
+	/**
+	 * The read position, only changed by the main loop.
+	 */
+	volatile ubyte rptr;
+
+	/**
+	 * The write position, only changed by the ISR.
+	 */
+	volatile ubyte wptr;
+
+	/**
+	 * The number of dropped frames.
+	 */
+	volatile ubyte lost;
+} xdata rx;
+
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+/**
+ * Copies all pending frames into the receive ring buffer.
+ *
+ * @private
+ */
+void hsk_can_isr_rx(void) using 1 {
+	/* Preserve the CAN_AD bus state of the interrupted code. */
+	uword adlh = CAN_ADLH;
+	uword data01 = CAN_DATA01;
+	uword data23 = CAN_DATA23;
+	hsk_can_frame xdata * frame;
+	ubyte msg;
+
+	CAN_ADLH = MSIDk;
+	CAN_AD_READ();
+	while ((msg = (CAN_DATA0 >> BIT_INDEX) & ((1 << CNT_INDEX) - 1)) \
+	       != INDEX_NONE) {
+		/* Clear the pending bit, only write the affected byte. */
+		CAN_ADLH = MSPNDk;
+		switch (msg >> 3) {
+		case 0:
+			CAN_DATA0 = ~(1 << (msg & 0x7));
+			break;
+		case 1:
+			CAN_DATA1 = ~(1 << (msg & 0x7));
+			break;
+		case 2:
+			CAN_DATA2 = ~(1 << (msg & 0x7));
+			break;
+		case 3:
+			CAN_DATA3 = ~(1 << (msg & 0x7));
+			break;
+		}
+		CAN_AD_WRITE(1 << (msg >> 3));
+
+		/* Check whether there is new data at all. */
+		CAN_ADLH = MOSTATn + (msg << OFF_MOn);
+		CAN_AD_READ();
+		/* Feed the timeout monitor, even if the buffer is full. */
+		if ((CAN_DATA0 & (1 << BIT_NEWDAT)) \
+		    && mon.entry[msg] != CAN_ERROR) {
+			mon.last[mon.entry[msg]] = mon.now;
+		}
+		if (!(CAN_DATA0 & (1 << BIT_NEWDAT))) {
+			/* Nothing to do. */
+		} else if (!(frame = hsk_pool_isr_alloc(&hsk_can_rx_pool))) {
+			/* Buffer full, leave the frame in the message object. */
+			if (rx.lost < 0xff) {
+				rx.lost++;
+			}
+		} else {
+			do {
+				/* Reset the new data and receive pending bits. */
+				RESET_DATA = (1 << BIT_NEWDAT) | (1 << BIT_RXPND);
+				CAN_AD_WRITE(RESET);
+
+				/* Walk through the message object registers. */
+				CAN_ADLH = MOFCRn + (msg << OFF_MOn);
+				CAN_AD_READ() | AUAD_INC1;
+				frame->dlc = (CAN_DATA3 >> BIT_DLC) & ((1 << CNT_DLC) - 1);
+				/* MOFGPRn */
+				CAN_AD_READ() | AUAD_INC1;
+				/* MOIPRn */
+				CAN_AD_READ() | AUAD_INC1;
+				frame->timestamp = MOIPRn_CFCVAL;
+				/* MOAMRn */
+				CAN_AD_READ() | AUAD_INC1;
+				/* MODATALn */
+				CAN_AD_READ() | AUAD_INC1;
+				frame->data[0] = CAN_DATA0;
+				frame->data[1] = CAN_DATA1;
+				frame->data[2] = CAN_DATA2;
+				frame->data[3] = CAN_DATA3;
+				/* MODATAHn */
+				CAN_AD_READ() | AUAD_INC1;
+				frame->data[4] = CAN_DATA0;
+				frame->data[5] = CAN_DATA1;
+				frame->data[6] = CAN_DATA2;
+				frame->data[7] = CAN_DATA3;
+				/* MOARn */
+				CAN_AD_READ() | AUAD_INC1;
+				#define extended ((CAN_DATA3 >> (BIT_IDE - 24)) & 1)
+				frame->id = CAN_DATA23;
+				frame->id <<= 16;
+				frame->id |= CAN_DATA01;
+				frame->id >>= extended ? BIT_IDEXT : BIT_IDSTD;
+				frame->id &= (1ul << (extended ? CNT_IDEXT : CNT_IDSTD)) - 1;
+				#undef extended
+				/* MOSTATn */
+				CAN_AD_READ();
+				/* Retry if the message was updated in between. */
+			} while (CAN_DATA0 & ((1 << BIT_NEWDAT) | (1 << BIT_RXUPD)));
+			frame->msg = msg;
+			rx.frames[rx.wptr] = frame;
+			rx.wptr = (rx.wptr + 1) & (CAN_RX_BUF_SIZE - 1);
+		}
+
+		/* Get the next pending message object. */
+		CAN_ADLH = MSIDk;
+		CAN_AD_READ();
+	}
+
+	/* Restore the CAN_AD bus state. */
+	CAN_ADLH = adlh;
+	CAN_DATA01 = data01;
+	CAN_DATA23 = data23;
+}
+#pragma restore
+
+void hsk_can_rx_init(void) {
+	/* Consider all message pending bits for the message index. */
+	CAN_ADLH = MSIMASK;
+	CAN_DATA01 = 0xffff;
+	CAN_DATA23 = 0xffff;
+	CAN_AD_WRITE(0xF);
+
+	/* Start with an empty buffer. */
+	EADC = 0;
+	rx.rptr = rx.wptr = rx.lost = 0;
+	hsk_can_rx_pool_init();
+
+	/* Hook into the shared ISR. */
+	hsk_isr6.CANSRC1 = &hsk_can_isr_rx;
+	EADC = 1;
+}
+
+ubyte hsk_can_rx_connect(const hsk_can_msg msg,
+		void (code * const __xdata callback)
+		     (const hsk_can_frame __xdata * const frame)) {
+	/* Check whether this is a valid message ID. */
+	if (msg >= HSK_CAN_MSG_MAX) {
+		return CAN_ERROR;
+	}
+	rx.callbacks[msg] = callback;
+
+	/* Point the receive interrupt to CANSRC1 and MSPND0. */
+	CAN_ADLH = MOIPRn + (msg << OFF_MOn);
+	CAN_AD_READ();
+	CAN_DATA0 = CAN_DATA0 & ~(((1 << CNT_RXINP) - 1) << BIT_RXINP) \
+		| (RXINP_CANSRC1 << BIT_RXINP);
+	MOIPRn_MPN = msg;
+	CAN_AD_WRITE(0x3);
+
+	/* Enable the receive interrupt. */
+	CAN_ADLH = MOFCRn + (msg << OFF_MOn);
+	CAN_AD_READ();
+	CAN_DATA2 |= 1 << BIT_RXIE;
+	CAN_AD_WRITE(0x4);
+
+	return 0;
+}
+
+ubyte hsk_can_rx_disconnect(const hsk_can_msg msg) {
+	/* Check whether this is a valid message ID. */
+	if (msg >= HSK_CAN_MSG_MAX) {
+		return CAN_ERROR;
+	}
+
+	/* Disable the receive interrupt. */
+	CAN_ADLH = MOFCRn + (msg << OFF_MOn);
+	CAN_AD_READ();
+	CAN_DATA2 &= ~(1 << BIT_RXIE);
+	CAN_AD_WRITE(0x4);
+
+	rx.callbacks[msg] = 0;
+	return 0;
+}
+
+const hsk_can_frame __xdata * hsk_can_rx_peek(void) {
+	if (rx.rptr == rx.wptr) {
+		return 0;
+	}
+	return rx.frames[rx.rptr];
+}
+
+void hsk_can_rx_next(void) {
+	if (rx.rptr != rx.wptr) {
+		hsk_pool_free(&hsk_can_rx_pool, rx.frames[rx.rptr]);
+		rx.rptr = (rx.rptr + 1) & (CAN_RX_BUF_SIZE - 1);
+	}
+}
+
+void hsk_can_rx_dispatch(void) {
+	hsk_can_frame xdata * frame;
+
+	while (rx.rptr != rx.wptr) {
+		frame = rx.frames[rx.rptr];
+		if (rx.callbacks[frame->msg]) {
+			rx.callbacks[frame->msg](frame);
+		}
+		hsk_pool_free(&hsk_can_rx_pool, frame);
+		rx.rptr = (rx.rptr + 1) & (CAN_RX_BUF_SIZE - 1);
+	}
+}
+
+ubyte hsk_can_rx_lost(void) {
+	ubyte lost;
+	bool eadc = EADC;
+
+	EADC = 0;
+	lost = rx.lost;
+	rx.lost = 0;
+	EADC = eadc;
+	return lost;
+}
+
 /**
  * Sets a signal value in a data field.
  *
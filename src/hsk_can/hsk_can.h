@@ -37,6 +37,31 @@
 #ifndef _HSK_CAN_H_
 #define _HSK_CAN_H_
 
+/*
+ * Required for SDCC to propagate ISR prototypes.
+ */
+#ifdef SDCC
+#include "../hsk_isr/hsk_isr.isr"
+#endif /* SDCC */
+
+#include "../hsk_pool/hsk_pool.h"
+
+/*
+ * SDCC does not like the \c code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
 /**
  * Value returned by functions in case of an error.
  */
@@ -352,6 +377,35 @@ ubyte hsk_can_msg_delete(const hsk_can_msg msg);
 void hsk_can_msg_getData(const hsk_can_msg msg,
                          ubyte * const msgdata);
 
+/**
+ * Gets a signal directly from a CAN message object.
+ *
+ * Only the data words (MODATALn and/or MODATAHn) the signal is located
+ * in are read, the remaining message data is not copied.
+ *
+ * The signal parameters are the same as for hsk_can_data_getSignal(),
+ * so signal configuration tuples can be used:
+ * \code
+ * speed = hsk_can_msg_getSignal(msg0, SIG_SPEED);
+ * \endcode
+ *
+ * @param msg
+ *	The identifier of the message object
+ * @param motorola
+ *	Indicates big endian (Motorola) encoding
+ * @param sign
+ *	Indicates whether the value has a signed type
+ * @param bitPos
+ *	The bit position of the signal
+ * @param bitCount
+ *	The length of the signal
+ * @return
+ *	The signal from the message object
+ */
+ulong hsk_can_msg_getSignal(const hsk_can_msg msg, const bool motorola,
+                            const bool sign, const ubyte bitPos,
+                            const char bitCount);
+
 /**
  * Sets the current data in the CAN message.
  *
@@ -394,6 +448,9 @@ bool hsk_can_msg_sent(const hsk_can_msg msg);
  * bus participants are ignored. This restores the original setting to receive
  * messages.
  *
+ * Messages that are already in RX mode are not touched, so calling this
+ * before every receive costs no MultiCAN access.
+ *
  * @param msg
  *	The identifier of the message to receive
  */
@@ -417,6 +474,80 @@ void hsk_can_msg_receive(const hsk_can_msg msg);
  */
 bool hsk_can_msg_updated(const hsk_can_msg msg);
 
+/**
+ * Reloads the software copy of the message object configuration.
+ *
+ * The library keeps a shadow table of the message object configuration
+ * (DLC, ID, mode and FIFO pointers), so frequently used functions do not
+ * have to read it back from the MultiCAN module. All library functions
+ * keep it up to date.
+ *
+ * Call this function after reconfiguring message objects through other
+ * means. Note that reception updates the DLC of a message object, so the
+ * transmit DLC of received message objects is adopted from the last
+ * received message.
+ */
+void hsk_can_resync(void);
+
+/** \file
+ * \section batch Batch Access
+ *
+ * Cyclic tasks that read or write several message objects at once can
+ * use the batch functions. The data of all messages is passed in a single
+ * buffer with 8 bytes per message, regardless of the DLC.
+ *
+ * \code
+ * static const hsk_can_msg code tx10ms[] = {...};
+ * ubyte xdata tx10msData[sizeof(tx10ms)][8];
+ * [...]
+ * hsk_can_batch_send(tx10ms, tx10msData[0], sizeof(tx10ms));
+ * \endcode
+ *
+ * The transmit DLC is cached at message creation time and the data words
+ * are written using the CAN_AD auto increment mode. hsk_can_batch_send()
+ * requests the transmission right after writing the data of each message,
+ * which saves the address setup of a separate hsk_can_msg_send() call.
+ */
+
+/**
+ * Gets the current data of several CAN messages.
+ *
+ * @param msgs
+ *	An array of message object identifiers
+ * @param msgdata
+ *	The buffer to store the message data in, 8 bytes per message
+ * @param count
+ *	The number of messages
+ */
+void hsk_can_batch_getData(const hsk_can_msg * const msgs,
+                           ubyte * const msgdata, const ubyte count);
+
+/**
+ * Sets the current data of several CAN messages.
+ *
+ * @param msgs
+ *	An array of message object identifiers
+ * @param msgdata
+ *	The buffer to get the message data from, 8 bytes per message
+ * @param count
+ *	The number of messages
+ */
+void hsk_can_batch_setData(const hsk_can_msg * const msgs,
+                           const ubyte * const msgdata, const ubyte count);
+
+/**
+ * Sets the data of several CAN messages and requests their transmission.
+ *
+ * @param msgs
+ *	An array of message object identifiers
+ * @param msgdata
+ *	The buffer to get the message data from, 8 bytes per message
+ * @param count
+ *	The number of messages
+ */
+void hsk_can_batch_send(const hsk_can_msg * const msgs,
+                        const ubyte * const msgdata, const ubyte count);
+
 /** \file
  * \section fifos FIFOs
  *
@@ -618,6 +749,474 @@ bool hsk_can_fifo_updated(const hsk_can_fifo fifo);
 void hsk_can_fifo_getData(const hsk_can_fifo fifo,
                           ubyte * const msgdata);
 
+/**
+ * Gets a signal directly from the currently selected FIFO entry.
+ *
+ * This is cheaper than copying the entire entry with
+ * hsk_can_fifo_getData() if only few signals are of interest.
+ *
+ * \code
+ * if (hsk_can_fifo_updated(fifo0)) {
+ * 	select = hsk_can_fifo_getSignal(fifo0, SIG_MULTIPLEXOR);
+ * 	[...]
+ * 	hsk_can_fifo_next(fifo0);
+ * }
+ * \endcode
+ *
+ * @see hsk_can_msg_getSignal()
+ * @param fifo
+ *	The identifier of the FIFO
+ * @param motorola
+ *	Indicates big endian (Motorola) encoding
+ * @param sign
+ *	Indicates whether the value has a signed type
+ * @param bitPos
+ *	The bit position of the signal
+ * @param bitCount
+ *	The length of the signal
+ * @return
+ *	The signal from the FIFO entry
+ */
+ulong hsk_can_fifo_getSignal(const hsk_can_fifo fifo, const bool motorola,
+                             const bool sign, const ubyte bitPos,
+                             const char bitCount);
+
+/** \file
+ * \section filters Acceptance Filters
+ *
+ * The number of message objects is limited, so receiving many different
+ * messages requires FIFOs with acceptance masks. The dbc2c.awk script
+ * plans a set of ID/mask pairs for every ECU, covering all messages it
+ * receives with the number of filters given by the FILTERS environment
+ * variable (default 8):
+ * \code
+ * hsk_can_fifo fifo = hsk_can_fifo_create(8);
+ * hsk_can_fifo_setupRx(fifo, FILTER_Ecu_0, 8);
+ * hsk_can_fifo_setRxMask(fifo, FILTERMSK_Ecu_0);
+ * \endcode
+ *
+ * Merging IDs into a single filter may accept IDs the ECU does not
+ * receive. The generated RXSTD_Ecu and RXEXT_Ecu lists can be used to
+ * reject them in software:
+ * \code
+ * const ulong code rxstd[] = {RXSTD_Ecu};
+ * ...
+ * if (hsk_can_filter_accept(hsk_can_fifo_getId(fifo), rxstd, RXSTDCNT_Ecu)) {
+ * \endcode
+ *
+ * If an ECU receives no IDs of a kind, the list holds a placeholder that
+ * matches no ID, so the initializer is never empty. The count is 0 then.
+ */
+
+/**
+ * Checks whether an ID is in a sorted list of IDs.
+ *
+ * This performs a binary search, so the cost only grows logarithmically
+ * with the length of the list.
+ *
+ * @param id
+ *	The ID to look up
+ * @param ids
+ *	The list of IDs in ascending order
+ * @param count
+ *	The number of IDs in the list
+ * @retval 1
+ *	The ID is in the list
+ * @retval 0
+ *	The ID is not in the list
+ */
+bool hsk_can_filter_accept(const ulong id, const ulong code * const ids,
+                           const ubyte count);
+
+/** \file
+ * \section rx Interrupt Driven Reception
+ *
+ * Polling hsk_can_msg_updated() costs several CAN bus accesses per message
+ * object, even if nothing was received. Alternatively message objects can
+ * be connected to a receive ring buffer, that is filled by the CANSRC1
+ * interrupt (shared ISR 6).
+ *
+ * Every buffered frame contains the message object it was received by,
+ * its ID, DLC, data and a time stamp. The time stamp is the value of the
+ * CAN node frame counter, which runs in time stamp mode and counts CAN bit
+ * times.
+ *
+ * Frames can be consumed in order:
+ * \code
+ * const hsk_can_frame __xdata * frame;
+ * while (frame = hsk_can_rx_peek()) {
+ * 	switch (frame->msg) {
+ * 	[...]
+ * 	}
+ * 	hsk_can_rx_next();
+ * }
+ * \endcode
+ *
+ * Or they can be handed to callback functions registered with
+ * hsk_can_rx_connect() by calling hsk_can_rx_dispatch() from the main
+ * loop.
+ *
+ * Frames arriving while the ring buffer is full are dropped and remain
+ * available through the message object, see hsk_can_rx_lost().
+ *
+ * The frames are allocated from the block pool \ref hsk_can_rx_pool,
+ * its \c peak member tells how much of the ring buffer was ever in use.
+ * Before hsk_can_rx_init() is called, the pool storage
+ * \c hsk_can_rx_pool_blocks can serve a different pool, e.g. during boot:
+ * \code
+ * hsk_pool_init(&bootPool, hsk_can_rx_pool_blocks,
+ *               sizeof(hsk_can_rx_pool_blocks), 16);
+ * \endcode
+ * All blocks of such a pool must be returned before calling
+ * hsk_can_rx_init(), which takes the storage back.
+ *
+ * The size of the ring buffer is set by \ref CAN_RX_BUF_SIZE.
+ *
+ * FIFOs cannot be connected to the ring buffer, it already serves the same
+ * purpose. Use hsk_can_fifo_setRxMask() on a regular message object to
+ * receive a range of IDs through the ring buffer.
+ */
+
+/**
+ * The size of the receive ring buffer.
+ *
+ * This must be a power of 2. One entry is always kept free to tell a full
+ * buffer from an empty one.
+ */
+#define CAN_RX_BUF_SIZE        8
+
+/**
+ * A frame stored in the receive ring buffer.
+ */
+typedef struct {
+	/**
+	 * The CAN ID of the frame.
+	 */
+	ulong id;
+
+	/**
+	 * The CAN node frame counter value at reception in CAN bit times.
+	 */
+	uword timestamp;
+
+	/**
+	 * The message object that received the frame.
+	 */
+	hsk_can_msg msg;
+
+	/**
+	 * The data length code of the frame.
+	 */
+	ubyte dlc;
+
+	/**
+	 * The frame data.
+	 */
+	ubyte data[8];
+} hsk_can_frame;
+
+/**
+ * Sets up interrupt driven reception.
+ *
+ * This hooks the receive ISR into the CANSRC1 interrupt and activates
+ * the shared ISR 6 by setting EADC.
+ *
+ * It has to be called after hsk_can_init() and before connecting the first
+ * message object.
+ */
+void hsk_can_rx_init(void);
+
+/**
+ * Connects a message object to the receive ring buffer.
+ *
+ * The message object is set up to raise the CANSRC1 interrupt upon
+ * reception, the ISR copies every received frame into the ring buffer.
+ *
+ * @param msg
+ *	The identifier of the message object
+ * @param callback
+ *	A function called by hsk_can_rx_dispatch() for every frame
+ *	received by this message object, may be 0
+ * @retval CAN_ERROR
+ *	The given message is not valid
+ * @retval 0
+ *	Success
+ */
+ubyte hsk_can_rx_connect(const hsk_can_msg msg,
+                         void (code * const __xdata callback)
+                              (const hsk_can_frame __xdata * const frame));
+
+/**
+ * Disconnects a message object from the receive ring buffer.
+ *
+ * Frames already stored in the ring buffer remain there.
+ *
+ * @param msg
+ *	The identifier of the message object
+ * @retval CAN_ERROR
+ *	The given message is not valid
+ * @retval 0
+ *	Success
+ */
+ubyte hsk_can_rx_disconnect(const hsk_can_msg msg);
+
+/**
+ * Returns the oldest frame in the receive ring buffer.
+ *
+ * The frame remains valid until hsk_can_rx_next() is called.
+ *
+ * @return
+ *	A pointer to the oldest frame or 0 if the ring buffer is empty
+ */
+const hsk_can_frame __xdata * hsk_can_rx_peek(void);
+
+/**
+ * Releases the oldest frame in the receive ring buffer.
+ *
+ * Does nothing if the ring buffer is empty.
+ */
+void hsk_can_rx_next(void);
+
+/**
+ * Hands all buffered frames to the callback functions of their message
+ * objects and empties the ring buffer.
+ *
+ * Frames of message objects without a callback function are discarded.
+ */
+void hsk_can_rx_dispatch(void);
+
+/**
+ * Returns the number of frames dropped due to a full ring buffer.
+ *
+ * The counter is reset by this call and saturates at 255.
+ *
+ * @return
+ *	The number of dropped frames since the last call
+ */
+ubyte hsk_can_rx_lost(void);
+
+/**
+ * The block pool providing the frames of the receive ring buffer.
+ *
+ * The pool is set up by hsk_can_rx_init(), its usage report shows how
+ * many frames were buffered at the same time.
+ */
+extern hsk_pool xdata hsk_can_rx_pool;
+
+/**
+ * The storage of \ref hsk_can_rx_pool.
+ *
+ * It may be used by a different pool until hsk_can_rx_init() is called.
+ */
+extern ubyte xdata hsk_can_rx_pool_blocks[sizeof(hsk_can_frame) \
+                                          * (CAN_RX_BUF_SIZE - 1)];
+
+/** \file
+ * \section mon Timeout Monitoring
+ *
+ * The timeout monitor supervises the reception of up to \ref CAN_MON_MAX
+ * messages. It is driven by calling hsk_can_mon_tick() from a timer
+ * callback:
+ * \code
+ * #pragma save
+ * #ifdef SDCC
+ * #pragma nooverlay
+ * #endif
+ * void tick0(void) using 1 {
+ * 	hsk_can_mon_tick();
+ * }
+ * #pragma restore
+ *
+ * ...
+ * hsk_timer0_setup(1000, &tick0);
+ * msgCtrl = hsk_can_msg_create(MSG_CTRL);
+ * hsk_can_mon_register(msgCtrl, TO_Ecu_SIG_CtrlValue);
+ * \endcode
+ *
+ * Messages connected to the receive buffer (see \ref rx) are fed to the
+ * monitor by the receive ISR. Polled messages have to be fed with
+ * hsk_can_mon_feed() whenever hsk_can_msg_updated() reports new data.
+ *
+ * Every tick checks a single monitor entry, so a timeout is detected
+ * up to \ref CAN_MON_MAX ticks late. The timeouts are collected in a
+ * bitmap, that can be retrieved with hsk_can_mon_getTimeouts().
+ */
+
+/**
+ * The maximum number of monitored messages.
+ */
+#define CAN_MON_MAX            16
+
+/**
+ * Counts a tick and checks the next monitor entry for a timeout.
+ *
+ * Call this from a timer callback.
+ */
+void hsk_can_mon_tick(void) using(1);
+
+/**
+ * Adds a message object to the timeout monitor.
+ *
+ * The timeout is counted in ticks, i.e. if the tick interval is 1ms, the
+ * generated \c TO_* constants can be used directly.
+ *
+ * @param msg
+ *	The identifier of the message object
+ * @param timeout
+ *	The timeout in ticks, in the range [1; 32767]
+ * @return
+ *	The monitor entry, i.e. the bit in the timeout bitmap, or CAN_ERROR
+ */
+ubyte hsk_can_mon_register(const hsk_can_msg msg, const uword timeout);
+
+/**
+ * Removes a message object from the timeout monitor.
+ *
+ * @param msg
+ *	The identifier of the message object
+ * @retval CAN_ERROR
+ *	The message object is not monitored
+ * @retval 0
+ *	Success
+ */
+ubyte hsk_can_mon_unregister(const hsk_can_msg msg);
+
+/**
+ * Reports the reception of a message to the timeout monitor.
+ *
+ * This is only required for messages not connected to the receive buffer.
+ *
+ * @param msg
+ *	The identifier of the message object
+ */
+void hsk_can_mon_feed(const hsk_can_msg msg);
+
+/**
+ * Returns whether a monitored message has timed out.
+ *
+ * @param msg
+ *	The identifier of the message object
+ * @retval 1
+ *	The message has timed out
+ * @retval 0
+ *	The message was received in time or is not monitored
+ */
+bool hsk_can_mon_timeout(const hsk_can_msg msg);
+
+/**
+ * Returns the timeout bitmap.
+ *
+ * @return
+ *	A bitmap with a bit set for every timed out monitor entry
+ */
+uword hsk_can_mon_getTimeouts(void);
+
+/** \file
+ * \section tx Cyclic Transmission
+ *
+ * The transmit scheduler sends messages from a table at their cycle
+ * times. It uses the ticks counted by hsk_can_mon_tick() as its time
+ * base, but the transmission itself happens in hsk_can_tx_run(), which
+ * should be called from the main loop:
+ * \code
+ * ubyte xdata ctrlData[DLC_CTRL];
+ * ubyte xdata statusData[DLC_STATUS];
+ *
+ * hsk_can_tx_entry xdata txTable[] = {
+ * 	{0, ctrlData, CYCLE_CTRL, FAST_CTRL},
+ * 	{0, statusData, CYCLE_STATUS, FAST_STATUS}
+ * };
+ * ...
+ * txTable[0].msg = hsk_can_msg_create(MSG_CTRL);
+ * txTable[1].msg = hsk_can_msg_create(MSG_STATUS);
+ * hsk_can_tx_init(txTable, sizeof(txTable) / sizeof(txTable[0]));
+ * ...
+ * for (;;) {
+ * 	hsk_can_tx_run();
+ * 	...
+ * }
+ * \endcode
+ *
+ * The first transmission of each entry is delayed by a fraction of its
+ * cycle time proportional to the entry's position in the table, so
+ * messages with equal cycle times are spread evenly over the cycle,
+ * instead of all being due in the same tick.
+ */
+
+/**
+ * The maximum number of entries in a transmit table.
+ */
+#define CAN_TX_MAX             16
+
+/**
+ * A transmit table entry.
+ */
+typedef struct {
+	/**
+	 * The message object to send.
+	 */
+	hsk_can_msg msg;
+
+	/**
+	 * The message data buffer.
+	 */
+	const ubyte * buf;
+
+	/**
+	 * The regular cycle time in ticks, 0 to only send on trigger.
+	 */
+	uword cycle;
+
+	/**
+	 * The fast cycle time in ticks, 0 to use the regular cycle time.
+	 */
+	uword fast;
+} hsk_can_tx_entry;
+
+/**
+ * Set up the transmit scheduler with a table of messages.
+ *
+ * @param table
+ *	The transmit table, it is referenced, not copied
+ * @param count
+ *	The number of table entries, at most \ref CAN_TX_MAX
+ * @retval CAN_ERROR
+ *	The table has too many entries
+ * @retval 0
+ *	Success
+ */
+ubyte hsk_can_tx_init(const hsk_can_tx_entry * const table,
+                      const ubyte count);
+
+/**
+ * Sends all messages that are due.
+ *
+ * The message data is updated from the entry buffer, before sending.
+ */
+void hsk_can_tx_run(void);
+
+/**
+ * Switch a table entry to or from its fast cycle time.
+ *
+ * Switching to the fast cycle also triggers an immediate transmission.
+ *
+ * @param entry
+ *	The index of the table entry
+ * @param fast
+ *	Set to use the fast cycle time
+ */
+void hsk_can_tx_setFast(const ubyte entry, const bool fast);
+
+/**
+ * Send a table entry with the next call of hsk_can_tx_run().
+ *
+ * The cycle restarts with the triggered transmission.
+ *
+ * @param entry
+ *	The index of the table entry
+ */
+void hsk_can_tx_trigger(const ubyte entry);
+
 /** \file
  * \section data Message Data
  *
@@ -630,6 +1229,11 @@ void hsk_can_fifo_getData(const hsk_can_fifo fifo,
  *
  * This conforms to the  way signal positions are stored in Vector CANdb++
  * DBC files.
+ *
+ * These functions compute shifts and masks at runtime, which is expensive
+ * on an 8051. Signals known at compile time should be accessed with the
+ * GET_* and SET_* macros generated by dbc2c.awk, which only consist of
+ * constant shifts and masks in the narrowest type fitting the signal.
  */
 
 /**
@@ -672,4 +1276,19 @@ ulong hsk_can_data_getSignal(const ubyte * const msg, const bool motorola,
                              const bool sign, const ubyte bitPos,
                              const char bitCount);
 
+/*
+ * Restore the usual meaning of \c code.
+ */
+#ifdef SDCC
+	#undef code
+	#define code	__code
+#endif /* SDCC */
+
+/*
+ * Restore the usual meaning of \c using(bank).
+ */
+#ifdef __C51__
+	#undef using
+#endif /* __C51__ */
+
 #endif /* _HSK_CAN_H_ */
@@ -4,6 +4,11 @@
  * This file implements the methods necessary to route µC pins to external
  * interrupts.
  *
+ * Debounced channels are locked by switching their trigger off in the
+ * EXICON0/1 registers, so a locked channel does not cause interrupts at
+ * all. The trigger is restored by hsk_ex_isr_tick() when the lockout
+ * ends.
+ *
  * @author kami
  */
 
@@ -74,7 +79,117 @@
  */
 #define BIT_IMODE          4
 
-void hsk_ex_channel_enable(const hsk_ex_channel channel,
+/**
+ * IRCON0 Interrupt Flag for External Interrupt 2 bit.
+ */
+#define BIT_EXINT2_FLAG    2
+
+/**
+ * The number of external interrupt channels.
+ */
+#define EX_CHANNELS        7
+
+/** \var debounce
+ * The debouncing state and event queue.
+ */
+static volatile struct {
+	/**
+	 * The event queue.
+	 */
+	hsk_ex_event events[EX_EVENTS];
+
+	/**
+	 * The queue position to write the next event to.
+	 */
+	ubyte head;
+
+	/**
+	 * The queue position to read the next event from.
+	 */
+	ubyte tail;
+
+	/**
+	 * The number of lost events.
+	 */
+	ubyte lost;
+
+	/**
+	 * A bit mask of the channels in lockout.
+	 */
+	ubyte locked;
+
+	/**
+	 * The event time in ticks.
+	 */
+	uword time;
+
+	/**
+	 * The lockout window of every channel, 0 for channels without
+	 * lockout.
+	 */
+	uword lockouts[EX_CHANNELS];
+
+	/**
+	 * The remaining lockout ticks of every channel.
+	 */
+	uword remaining[EX_CHANNELS];
+
+	/**
+	 * The trigger edge of every channel, to restore after a lockout.
+	 */
+	ubyte edges[EX_CHANNELS];
+} xdata debounce;
+
+/**
+ * Sets the trigger of one of the channels EXINT2 to EXINT6.
+ *
+ * @param channel
+ *	The channel to set the trigger for
+ * @param edge
+ *	The trigger, one of \ref EX_EDGE or EX_EDGE_DISABLE
+ * @private
+ */
+#define EX_TRIGGER(channel, edge) { \
+	if ((channel) < EX_EXINT4) { \
+		EXICON0 = EXICON0 & ~(((1 << CNT_EXINT) - 1) << ((channel) << 1)) \
+			| ((edge) << ((channel) << 1)); \
+	} else { \
+		EXICON1 = EXICON1 & ~(((1 << CNT_EXINT) - 1) << (((channel) - EX_EXINT4) << 1)) \
+			| ((edge) << (((channel) - EX_EXINT4) << 1)); \
+	} \
+}
+
+/**
+ * Ends debouncing of a channel.
+ *
+ * @param channel
+ *	The channel to stop debouncing
+ * @private
+ */
+#define EX_UNLOCK(channel) { \
+	bool ea = EA; \
+	EA = 0; \
+	debounce.lockouts[channel] = 0; \
+	debounce.locked &= ~(1 << (channel)); \
+	EA = ea; \
+}
+
+/**
+ * Configures and enables an external interrupt channel.
+ *
+ * This is called instead of hsk_ex_channel_enable() internally, because
+ * the isrconf.awk script would register every shared external interrupt
+ * for a call with a variable channel.
+ *
+ * @param channel
+ *	The channel to activate, one of \ref EX_EXINT
+ * @param edge
+ *	The triggering edge, one of \ref EX_EDGE
+ * @param callback
+ *	The callback function for an interrupt event
+ * @private
+ */
+void hsk_ex_channel_config(const hsk_ex_channel channel,
                            const ubyte edge,
                            const void (code * const callback)(void) using(1)) {
 
@@ -142,6 +257,13 @@ void hsk_ex_channel_enable(const hsk_ex_channel channel,
 	SYSCON0 |= 1 << BIT_IMODE;
 }
 
+void hsk_ex_channel_enable(const hsk_ex_channel channel,
+                           const ubyte edge,
+                           const void (code * const callback)(void) using(1)) {
+	EX_UNLOCK(channel);
+	hsk_ex_channel_config(channel, edge, callback);
+}
+
 /**
  * \addtogroup EX_EDGE
  * @{
@@ -157,6 +279,7 @@ void hsk_ex_channel_enable(const hsk_ex_channel channel,
  */
 
 void hsk_ex_channel_disable(const hsk_ex_channel channel) {
+	EX_UNLOCK(channel);
 	switch (channel) {
 	case EX_EXINT0:
 		EXICON0 = EXICON0 & ~(((1 << CNT_EXINT) - 1) << BIT_EXINT0)
@@ -191,6 +314,161 @@ void hsk_ex_channel_disable(const hsk_ex_channel channel) {
 	}
 }
 
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+/**
+ * Queues an event and starts the lockout of a debounced channel.
+ *
+ * @param channel
+ *	The channel that triggered
+ * @private
+ */
+void hsk_ex_isr_event(const hsk_ex_channel channel) using 1 {
+	ubyte head;
+	bool ea = EA;
+	EA = 0;
+
+	/* Drop edges that were flagged before the trigger was disabled. */
+	if ((debounce.locked >> channel) & 1) {
+		EA = ea;
+		return;
+	}
+
+	/* Lock the channel. */
+	if (debounce.lockouts[channel]) {
+		debounce.locked |= 1 << channel;
+		debounce.remaining[channel] = debounce.lockouts[channel];
+		EX_TRIGGER(channel, EX_EDGE_DISABLE);
+	}
+
+	/* Queue the event. */
+	head = (debounce.head + 1) & (EX_EVENTS - 1);
+	if (head == debounce.tail) {
+		if (debounce.lost < 0xff) {
+			debounce.lost++;
+		}
+	} else {
+		debounce.events[debounce.head].time = debounce.time;
+		debounce.events[debounce.head].channel = channel;
+		debounce.head = head;
+	}
+	EA = ea;
+}
+
+/**
+ * The EXINT2 callback for debounced events.
+ *
+ * @private
+ */
+void hsk_ex_isr_exint2(void) using 1 {
+	/* The shared ISR only acknowledges EXINT3 to EXINT6. */
+	IRCON0 &= ~(1 << BIT_EXINT2_FLAG);
+	hsk_ex_isr_event(EX_EXINT2);
+}
+
+/**
+ * The EXINT3 callback for debounced events.
+ *
+ * @private
+ */
+void hsk_ex_isr_exint3(void) using 1 {
+	hsk_ex_isr_event(EX_EXINT3);
+}
+
+/**
+ * The EXINT4 callback for debounced events.
+ *
+ * @private
+ */
+void hsk_ex_isr_exint4(void) using 1 {
+	hsk_ex_isr_event(EX_EXINT4);
+}
+
+/**
+ * The EXINT5 callback for debounced events.
+ *
+ * @private
+ */
+void hsk_ex_isr_exint5(void) using 1 {
+	hsk_ex_isr_event(EX_EXINT5);
+}
+
+/**
+ * The EXINT6 callback for debounced events.
+ *
+ * @private
+ */
+void hsk_ex_isr_exint6(void) using 1 {
+	hsk_ex_isr_event(EX_EXINT6);
+}
+
+void hsk_ex_isr_tick(void) using 1 {
+	hsk_ex_channel i;
+	bool ea = EA;
+	EA = 0;
+
+	debounce.time++;
+	for (i = EX_EXINT2; debounce.locked && i < EX_CHANNELS; i++) {
+		if (((debounce.locked >> i) & 1) && !--debounce.remaining[i]) {
+			debounce.locked &= ~(1 << i);
+			EX_TRIGGER(i, debounce.edges[i]);
+		}
+	}
+	EA = ea;
+}
+#pragma restore
+
+void hsk_ex_channel_debounce(const hsk_ex_channel channel,
+                             const ubyte edge, const uword lockout) {
+	bool ea;
+
+	/* Reset the lockout state. */
+	ea = EA;
+	EA = 0;
+	debounce.locked &= ~(1 << channel);
+	debounce.lockouts[channel] = lockout;
+	debounce.edges[channel] = edge;
+	EA = ea;
+
+	/*
+	 * The isrconf.awk and overlays.awk scripts pick the callbacks up
+	 * from the hsk_ex_channel_debounce() calls.
+	 */
+	switch (channel) {
+	case EX_EXINT2:
+		hsk_ex_channel_config(channel, edge, hsk_ex_isr_exint2);
+		break;
+	case EX_EXINT3:
+		hsk_ex_channel_config(channel, edge, hsk_ex_isr_exint3);
+		break;
+	case EX_EXINT4:
+		hsk_ex_channel_config(channel, edge, hsk_ex_isr_exint4);
+		break;
+	case EX_EXINT5:
+		hsk_ex_channel_config(channel, edge, hsk_ex_isr_exint5);
+		break;
+	case EX_EXINT6:
+		hsk_ex_channel_config(channel, edge, hsk_ex_isr_exint6);
+		break;
+	}
+}
+
+bool hsk_ex_event_get(hsk_ex_event xdata * const event) {
+	if (debounce.tail == debounce.head) {
+		return 0;
+	}
+	event->time = debounce.events[debounce.tail].time;
+	event->channel = debounce.events[debounce.tail].channel;
+	debounce.tail = (debounce.tail + 1) & (EX_EVENTS - 1);
+	return 1;
+}
+
+ubyte hsk_ex_events_lost(void) {
+	return debounce.lost;
+}
+
 /** \var ports
  * External input configuration structure.
  */
@@ -4,6 +4,26 @@
  * This file offers functions to activate external interrupts and connect
  * them to the available input pins.
  *
+ * Channels can also be enabled with hsk_ex_channel_debounce(), instead of
+ * calling back into user code on every edge, the edges are then
+ * timestamped and queued for the main loop to fetch with
+ * hsk_ex_event_get(). After an edge the interrupt of the channel is
+ * disabled for a lockout window, so a bouncing switch or a noisy line
+ * cannot cause more than one interrupt per window.
+ *
+ * The timestamps and lockout windows are counted in ticks of
+ * hsk_ex_isr_tick(), which has to be called back by a timer, e.g.
+ * a periodic hsk_wheel_isr_create() timer. Pass its address directly, so
+ * the overlays.awk script adds it to the call tree of the ISR:
+ * \code
+ * hsk_wheel_isr_create(&hsk_ex_isr_tick);
+ * \endcode
+ * Otherwise the following C51 overlay directive has to be added
+ * manually:
+ * \code
+ * hsk_wheel_isr_tick ! (hsk_ex_isr_tick)
+ * \endcode
+ *
  * @author kami
  */
 
@@ -148,6 +168,81 @@ void hsk_ex_channel_enable(const hsk_ex_channel channel,
  */
 void hsk_ex_channel_disable(const hsk_ex_channel channel);
 
+/**
+ * The size of the event queue, has to be a power of 2.
+ *
+ * One slot is kept free to tell a full queue from an empty one.
+ */
+#define EX_EVENTS          8
+
+/**
+ * A queued external interrupt event.
+ */
+typedef struct {
+	/**
+	 * The hsk_ex_isr_tick() time of the event.
+	 */
+	uword time;
+
+	/**
+	 * The channel that triggered, one of \ref EX_EXINT.
+	 */
+	hsk_ex_channel channel;
+} hsk_ex_event;
+
+/**
+ * Enable an external interrupt channel with queued, debounced events.
+ *
+ * Only the shared channels EXINT2 to EXINT6 are supported.
+ *
+ * Every accepted edge is queued, then the channel is locked for lockout
+ * ticks. Edges during the lockout are lost. The lockout ends with the
+ * lockout-th call of hsk_ex_isr_tick() after the edge, so the window
+ * lasts at least lockout - 1 ticks.
+ *
+ * Use hsk_ex_channel_enable() or hsk_ex_channel_disable() to end the
+ * debouncing of a channel.
+ *
+ * @param channel
+ *	The channel to activate, one of \ref EX_EXINT
+ * @param edge
+ *	The triggering edge, one of \ref EX_EDGE
+ * @param lockout
+ *	The number of ticks to ignore the channel after an edge, 0 to
+ *	queue every edge
+ */
+void hsk_ex_channel_debounce(const hsk_ex_channel channel,
+                             const ubyte edge, const uword lockout);
+
+/**
+ * Advances the event time and ends lockouts.
+ *
+ * Use this as a timer callback.
+ */
+void hsk_ex_isr_tick(void) using(1);
+
+/**
+ * Fetches the oldest queued event.
+ *
+ * @param event
+ *	The structure to store the event in
+ * @retval 1
+ *	An event was fetched
+ * @retval 0
+ *	The queue is empty
+ */
+bool hsk_ex_event_get(hsk_ex_event xdata * const event);
+
+/**
+ * Returns the number of events lost due to a full queue.
+ *
+ * The counter saturates at 255.
+ *
+ * @return
+ *	The number of lost events
+ */
+ubyte hsk_ex_events_lost(void);
+
 /**
  * Typedef for externel interrupt ports.
  */
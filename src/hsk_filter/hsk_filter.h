@@ -6,6 +6,28 @@
  *
  * The buffer for the filter is stored in xdata memory.
  *
+ * The regular factories need a modulo and a division for every update,
+ * which are expensive on the 8051. The *_POW2_* factories restrict the
+ * buffer length to powers of 2, so a mask and a shift suffice. The
+ * *_IIR_* factories provide an exponential low pass filter, which does
+ * not need a buffer at all.
+ *
+ * The MEDIAN_* factories provide median filters for spike rejection.
+ *
+ * Filters that are updated from an ISR can be created with the *_ISR_*
+ * factories, which generate update functions using register bank 1.
+ * The FILTER_POW2_ISR_* factories keep the modulo and the division out
+ * of the interrupt context. Surround them with pragmas to prevent
+ * overlaying their locals:
+ * \code
+ * #pragma save
+ * #ifdef SDCC
+ * #pragma nooverlay
+ * #endif
+ * FILTER_POW2_ISR_FACTORY(filter7, uword, uword, ubyte, 4)
+ * #pragma restore
+ * \endcode
+ *
  * @author kami
  */
 
@@ -154,5 +176,741 @@
 	} \
 
 
+/**
+ * Generates a filter with a buffer length that is a power of 2.
+ *
+ * The filter can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes the filter with 0
+ * - \<valueType\> \<prefix\>_update(const \<valueType\> value)
+ *	- Update the filter and return the current average
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param valueType
+ *	The data type of the stored values
+ * @param sumType
+ *	A data type that can contain the sum of all buffered values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param exp
+ *	The length of the buffer is \f$2^{exp}\f$
+ */
+#define FILTER_POW2_FACTORY(prefix, valueType, sumType, sizeType, exp) \
+	\
+	/**
+	 * Holds the buffer and its current state.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[1 << (exp)]; \
+	\
+		/**
+		 * The sum of the buffered values.
+		 */ \
+		sumType sum; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	} xdata prefix; \
+	\
+	/**
+	 * Initializes the buffer with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the filter and returns the current sliding average of
+	 * buffered values.
+	 *
+	 * @param value
+	 *	The value to add to the buffer
+	 * @return
+	 *	The average of the buffed values
+	 */ \
+	valueType prefix##_update(const valueType value) { \
+		prefix.sum -= prefix.values[prefix.current]; \
+		prefix.values[prefix.current++] = value; \
+		prefix.sum += value; \
+		prefix.current &= (1 << (exp)) - 1; \
+		return prefix.sum >> (exp); \
+	} \
+
+
+/**
+ * Generates a group of filters with a buffer length that is a power of 2.
+ *
+ * The filters can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes all filters with 0
+ * - \<valueType\> \<prefix\>_update(const ubyte filter, const \<valueType\> value)
+ *	- Update the given filter and return the current average
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param filters
+ *	The number of filters
+ * @param valueType
+ *	The data type of the stored values
+ * @param sumType
+ *	A data type that can contain the sum of all buffered values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param exp
+ *	The length of the buffer is \f$2^{exp}\f$
+ */
+#define FILTER_POW2_GROUP_FACTORY(prefix, filters, valueType, sumType, sizeType, exp) \
+	\
+	/**
+	 * Holds the buffers and their current states.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[1 << (exp)]; \
+	\
+		/**
+		 * The sum of the buffered values.
+		 */ \
+		sumType sum; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	} xdata prefix[filters]; \
+	\
+	/**
+	 * Initializes all buffers with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the given filter and returns the current sliding average of
+	 * buffered values.
+	 *
+	 * @param filter
+	 *	The filter to update
+	 * @param value
+	 *	The value to add to the buffer
+	 * @return
+	 *	The average of the buffed values
+	 */ \
+	valueType prefix##_update(const ubyte filter, const valueType value) { \
+		prefix[filter].sum -= prefix[filter].values[prefix[filter].current]; \
+		prefix[filter].values[prefix[filter].current++] = value; \
+		prefix[filter].sum += value; \
+		prefix[filter].current &= (1 << (exp)) - 1; \
+		return prefix[filter].sum >> (exp); \
+	} \
+
+
+/**
+ * Generates an exponential low pass filter.
+ *
+ * The filter keeps the scaled filter state \f$s = 2^{exp} \cdot y\f$ and
+ * updates it with:
+ * \f[s_{n} = s_{n-1} - \frac{s_{n-1}}{2^{exp}} + x_{n}\f]
+ *
+ * I.e. every value contributes \f$2^{-exp}\f$ to the output, which
+ * roughly corresponds to a sliding average over \f$2^{exp + 1}\f$ values.
+ *
+ * The filter can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes the filter with 0
+ * - \<valueType\> \<prefix\>_update(const \<valueType\> value)
+ *	- Update the filter and return the current output
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param valueType
+ *	The data type of the filtered values
+ * @param sumType
+ *	A data type that can contain a value multiplied with \f$2^{exp}\f$
+ * @param exp
+ *	The filter coefficient exponent
+ */
+#define FILTER_IIR_FACTORY(prefix, valueType, sumType, exp) \
+	\
+	/**
+	 * Holds the scaled filter state.
+	 */ \
+	sumType xdata prefix; \
+	\
+	/**
+	 * Initializes the filter with 0.
+	 */ \
+	void prefix##_init(void) { \
+		prefix = 0; \
+	} \
+	\
+	/**
+	 * Updates the filter and returns the current output.
+	 *
+	 * @param value
+	 *	The value to feed into the filter
+	 * @return
+	 *	The filter output
+	 */ \
+	valueType prefix##_update(const valueType value) { \
+		prefix -= prefix >> (exp); \
+		prefix += value; \
+		return prefix >> (exp); \
+	} \
+
+
+/**
+ * Generates a group of exponential low pass filters.
+ *
+ * See \ref FILTER_IIR_FACTORY.
+ *
+ * The filters can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes all filters with 0
+ * - \<valueType\> \<prefix\>_update(const ubyte filter, const \<valueType\> value)
+ *	- Update the given filter and return the current output
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param filters
+ *	The number of filters
+ * @param valueType
+ *	The data type of the filtered values
+ * @param sumType
+ *	A data type that can contain a value multiplied with \f$2^{exp}\f$
+ * @param exp
+ *	The filter coefficient exponent
+ */
+#define FILTER_IIR_GROUP_FACTORY(prefix, filters, valueType, sumType, exp) \
+	\
+	/**
+	 * Holds the scaled filter states.
+	 */ \
+	sumType xdata prefix[filters]; \
+	\
+	/**
+	 * Initializes all filters with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the given filter and returns the current output.
+	 *
+	 * @param filter
+	 *	The filter to update
+	 * @param value
+	 *	The value to feed into the filter
+	 * @return
+	 *	The filter output
+	 */ \
+	valueType prefix##_update(const ubyte filter, const valueType value) { \
+		prefix[filter] -= prefix[filter] >> (exp); \
+		prefix[filter] += value; \
+		return prefix[filter] >> (exp); \
+	} \
+
+
+/**
+ * Generates a median filter.
+ *
+ * A median filter rejects single spikes completely, instead of smearing
+ * them over the whole window like a sliding average.
+ *
+ * Apart from the buffer in insertion order the filter keeps a sorted
+ * copy of the buffer. Every update replaces the oldest value in the
+ * sorted copy with the new one, by moving the values in between by one
+ * position. So there is no sorting, the cost grows linearly with the
+ * buffer length.
+ *
+ * The filter can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes the filter with 0
+ * - \<valueType\> \<prefix\>_update(const \<valueType\> value)
+ *	- Update the filter and return the current median
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param valueType
+ *	The data type of the stored values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param size
+ *	The length of the buffer, should be odd
+ */
+#define MEDIAN_FILTER_FACTORY(prefix, valueType, sizeType, size) \
+	\
+	/**
+	 * Holds the buffer and its current state.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[size]; \
+	\
+		/**
+		 * The buffered values in ascending order.
+		 */ \
+		valueType sorted[size]; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	} xdata prefix; \
+	\
+	/**
+	 * Initializes the buffer with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the filter and returns the current median of buffered
+	 * values.
+	 *
+	 * @param value
+	 *	The value to add to the buffer
+	 * @return
+	 *	The median of the buffered values
+	 */ \
+	valueType prefix##_update(const valueType value) { \
+		sizeType i; \
+		const valueType old = prefix.values[prefix.current]; \
+	\
+		prefix.values[prefix.current] = value; \
+		if (++prefix.current >= (size)) { \
+			prefix.current = 0; \
+		} \
+		/* Find the oldest value in the sorted window. */ \
+		for (i = 0; prefix.sorted[i] != old; i++); \
+		/* Move smaller values down. */ \
+		for (; i < (size) - 1 && prefix.sorted[i + 1] < value; i++) { \
+			prefix.sorted[i] = prefix.sorted[i + 1]; \
+		} \
+		/* Move greater values up. */ \
+		for (; i > 0 && prefix.sorted[i - 1] > value; i--) { \
+			prefix.sorted[i] = prefix.sorted[i - 1]; \
+		} \
+		prefix.sorted[i] = value; \
+		return prefix.sorted[(size) / 2]; \
+	} \
+
+
+/**
+ * Generates a group of median filters.
+ *
+ * See \ref MEDIAN_FILTER_FACTORY.
+ *
+ * The filters can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes all filters with 0
+ * - \<valueType\> \<prefix\>_update(const ubyte filter, const \<valueType\> value)
+ *	- Update the given filter and return the current median
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param filters
+ *	The number of filters
+ * @param valueType
+ *	The data type of the stored values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param size
+ *	The length of the buffer, should be odd
+ */
+#define MEDIAN_FILTER_GROUP_FACTORY(prefix, filters, valueType, sizeType, size) \
+	\
+	/**
+	 * Holds the buffers and their current states.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[size]; \
+	\
+		/**
+		 * The buffered values in ascending order.
+		 */ \
+		valueType sorted[size]; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	} xdata prefix[filters]; \
+	\
+	/**
+	 * Initializes all buffers with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the given filter and returns the current median of
+	 * buffered values.
+	 *
+	 * @param filter
+	 *	The filter to update
+	 * @param value
+	 *	The value to add to the buffer
+	 * @return
+	 *	The median of the buffered values
+	 */ \
+	valueType prefix##_update(const ubyte filter, const valueType value) { \
+		sizeType i; \
+		const valueType old = prefix[filter].values[prefix[filter].current]; \
+	\
+		prefix[filter].values[prefix[filter].current] = value; \
+		if (++prefix[filter].current >= (size)) { \
+			prefix[filter].current = 0; \
+		} \
+		/* Find the oldest value in the sorted window. */ \
+		for (i = 0; prefix[filter].sorted[i] != old; i++); \
+		/* Move smaller values down. */ \
+		for (; i < (size) - 1 && prefix[filter].sorted[i + 1] < value; i++) { \
+			prefix[filter].sorted[i] = prefix[filter].sorted[i + 1]; \
+		} \
+		/* Move greater values up. */ \
+		for (; i > 0 && prefix[filter].sorted[i - 1] > value; i--) { \
+			prefix[filter].sorted[i] = prefix[filter].sorted[i - 1]; \
+		} \
+		prefix[filter].sorted[i] = value; \
+		return prefix[filter].sorted[(size) / 2]; \
+	} \
+
+
+/**
+ * Generates a filter for use in an ISR.
+ *
+ * This is identical to \ref FILTER_FACTORY, except that the update
+ * function uses register bank 1, so it can be called from an ISR or
+ * ISR callback, e.g. by passing it to hsk_adc_filter().
+ *
+ * Functions using a register bank cannot reliably return values, so
+ * the update function stores the average in \<prefix\>.average instead
+ * of returning it.
+ *
+ * The buffer index is wrapped without a modulo, the average still needs
+ * a division. Use \ref FILTER_POW2_ISR_FACTORY to avoid it.
+ *
+ * The filter can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes the filter with 0
+ * - void \<prefix\>_update(const \<valueType\> value) using 1
+ *	- Update the filter and store the current average
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param valueType
+ *	The data type of the stored values
+ * @param sumType
+ *	A data type that can contain the sum of all buffered values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param size
+ *	The length of the buffer
+ */
+#define FILTER_ISR_FACTORY(prefix, valueType, sumType, sizeType, size) \
+	\
+	/**
+	 * Holds the buffer and its current state.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[size]; \
+	\
+		/**
+		 * The sum of the buffered values.
+		 */ \
+		sumType sum; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	\
+		/**
+		 * The average of the buffered values.
+		 */ \
+		valueType average; \
+	} xdata prefix; \
+	\
+	/**
+	 * Initializes the buffer with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the filter and stores the current sliding average of
+	 * buffered values in \<prefix\>.average.
+	 *
+	 * @param value
+	 *	The value to add to the buffer
+	 */ \
+	void prefix##_update(const valueType value) using 1 { \
+		prefix.sum -= prefix.values[prefix.current]; \
+		prefix.values[prefix.current++] = value; \
+		prefix.sum += value; \
+		if (prefix.current >= (size)) { \
+			prefix.current = 0; \
+		} \
+		prefix.average = prefix.sum / (size); \
+	} \
+
+
+/**
+ * Generates a group of filters for use in an ISR.
+ *
+ * This is identical to \ref FILTER_GROUP_FACTORY, except that the update
+ * function uses register bank 1, see \ref FILTER_ISR_FACTORY.
+ *
+ * The filters can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes all filters with 0
+ * - void \<prefix\>_update(const ubyte filter, const \<valueType\> value) using 1
+ *	- Update the given filter and store its current average in
+ *	  \<prefix\>[filter].average
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param filters
+ *	The number of filters
+ * @param valueType
+ *	The data type of the stored values
+ * @param sumType
+ *	A data type that can contain the sum of all buffered values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param size
+ *	The length of the buffer
+ */
+#define FILTER_ISR_GROUP_FACTORY(prefix, filters, valueType, sumType, sizeType, size) \
+	\
+	/**
+	 * Holds the buffers and their current states.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[size]; \
+	\
+		/**
+		 * The sum of the buffered values.
+		 */ \
+		sumType sum; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	\
+		/**
+		 * The average of the buffered values.
+		 */ \
+		valueType average; \
+	} xdata prefix[filters]; \
+	\
+	/**
+	 * Initializes all buffers with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the given filter and stores the current sliding average
+	 * of buffered values in \<prefix\>[filter].average.
+	 *
+	 * @param filter
+	 *	The filter to update
+	 * @param value
+	 *	The value to add to the buffer
+	 */ \
+	void prefix##_update(const ubyte filter, const valueType value) using 1 { \
+		prefix[filter].sum -= prefix[filter].values[prefix[filter].current]; \
+		prefix[filter].values[prefix[filter].current++] = value; \
+		prefix[filter].sum += value; \
+		if (prefix[filter].current >= (size)) { \
+			prefix[filter].current = 0; \
+		} \
+		prefix[filter].average = prefix[filter].sum / (size); \
+	} \
+
+
+/**
+ * Generates a filter with a buffer length that is a power of 2 for use
+ * in an ISR.
+ *
+ * This is identical to \ref FILTER_POW2_FACTORY, except that the update
+ * function uses register bank 1, see \ref FILTER_ISR_FACTORY. The update
+ * only needs a mask and a shift.
+ *
+ * The filter can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes the filter with 0
+ * - void \<prefix\>_update(const \<valueType\> value) using 1
+ *	- Update the filter and store the current average
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param valueType
+ *	The data type of the stored values
+ * @param sumType
+ *	A data type that can contain the sum of all buffered values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param exp
+ *	The length of the buffer is \f$2^{exp}\f$
+ */
+#define FILTER_POW2_ISR_FACTORY(prefix, valueType, sumType, sizeType, exp) \
+	\
+	/**
+	 * Holds the buffer and its current state.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[1 << (exp)]; \
+	\
+		/**
+		 * The sum of the buffered values.
+		 */ \
+		sumType sum; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	\
+		/**
+		 * The average of the buffered values.
+		 */ \
+		valueType average; \
+	} xdata prefix; \
+	\
+	/**
+	 * Initializes the buffer with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the filter and stores the current sliding average of
+	 * buffered values in \<prefix\>.average.
+	 *
+	 * @param value
+	 *	The value to add to the buffer
+	 */ \
+	void prefix##_update(const valueType value) using 1 { \
+		prefix.sum -= prefix.values[prefix.current]; \
+		prefix.values[prefix.current++] = value; \
+		prefix.sum += value; \
+		prefix.current &= (1 << (exp)) - 1; \
+		prefix.average = prefix.sum >> (exp); \
+	} \
+
+
+/**
+ * Generates a group of filters with a buffer length that is a power of 2
+ * for use in an ISR.
+ *
+ * This is identical to \ref FILTER_POW2_GROUP_FACTORY, except that the
+ * update function uses register bank 1, see \ref FILTER_ISR_FACTORY.
+ * The update only needs a mask and a shift.
+ *
+ * The filters can be accessed with:
+ * - void \<prefix\>_init(void)
+ *	- Initializes all filters with 0
+ * - void \<prefix\>_update(const ubyte filter, const \<valueType\> value) using 1
+ *	- Update the given filter and store its current average in
+ *	  \<prefix\>[filter].average
+ *
+ * @param prefix
+ *	A prefix for the generated internals and functions
+ * @param filters
+ *	The number of filters
+ * @param valueType
+ *	The data type of the stored values
+ * @param sumType
+ *	A data type that can contain the sum of all buffered values
+ * @param sizeType
+ *	A data type that can hold the length of the buffer
+ * @param exp
+ *	The length of the buffer is \f$2^{exp}\f$
+ */
+#define FILTER_POW2_ISR_GROUP_FACTORY(prefix, filters, valueType, sumType, sizeType, exp) \
+	\
+	/**
+	 * Holds the buffers and their current states.
+	 */ \
+	struct { \
+		/**
+		 * The value buffer.
+		 */ \
+		valueType values[1 << (exp)]; \
+	\
+		/**
+		 * The sum of the buffered values.
+		 */ \
+		sumType sum; \
+	\
+		/**
+		 * The index of the oldest buffered value.
+		 */ \
+		sizeType current; \
+	\
+		/**
+		 * The average of the buffered values.
+		 */ \
+		valueType average; \
+	} xdata prefix[filters]; \
+	\
+	/**
+	 * Initializes all buffers with 0.
+	 */ \
+	void prefix##_init(void) { \
+		memset(&prefix, 0, sizeof(prefix)); \
+	} \
+	\
+	/**
+	 * Updates the given filter and stores the current sliding average
+	 * of buffered values in \<prefix\>[filter].average.
+	 *
+	 * @param filter
+	 *	The filter to update
+	 * @param value
+	 *	The value to add to the buffer
+	 */ \
+	void prefix##_update(const ubyte filter, const valueType value) using 1 { \
+		prefix[filter].sum -= prefix[filter].values[prefix[filter].current]; \
+		prefix[filter].values[prefix[filter].current++] = value; \
+		prefix[filter].sum += value; \
+		prefix[filter].current &= (1 << (exp)) - 1; \
+		prefix[filter].average = prefix[filter].sum >> (exp); \
+	} \
+
+
 #endif /* _HSK_FILTER_H_ */
 
@@ -23,6 +23,23 @@
  * Due to the \ref flash_byte_order differences between SDCC and C51, the
  * \ref DPL and \ref DPH macros are used to adjust DPTR assignments in
  * inline assembler.
+ *
+ * \section flash_entries Record Store Entries
+ *
+ * The record store writes entries of \ref ENTRY_SIZE bytes:
+ *
+ * | Byte | Content
+ * |------|--------------------------------------------------------
+ * | 0    | Record ident, created from the version like the struct ident
+ * | 1    | Record key, \ref KEY_SNAPSHOT marks the start of a snapshot
+ * | 2    | Offset of the data in the record
+ * | 3-6  | Record data
+ * | 7    | Checksum
+ *
+ * A snapshot is a series of entries covering an entire record. Every
+ * record has a base, the position of the oldest entry still required
+ * to restore it. That is either the last complete snapshot or the first
+ * entry of the record. Pages without a base can be deleted.
  */
 
 #include <Infineon/XC878.h>
@@ -415,6 +432,82 @@ SFR(FCS1,    0xDD);
  */
 #define FREE_NONE                   2
 
+/**
+ * Creates the prefix to identify data in the flash from a version.
+ *
+ * @param version
+ *	The version of the data
+ */
+#define IDENT(version)              (((version) & 0x3f) | 0x40)
+
+/**
+ * The size of a record store entry.
+ */
+#define ENTRY_SIZE                  8
+
+/**
+ * The number of record data bytes in an entry.
+ */
+#define ENTRY_DATA                  4
+
+/**
+ * Entry byte with the record ident.
+ */
+#define ENTRY_IDENT                 0
+
+/**
+ * Entry byte with the record key.
+ */
+#define ENTRY_KEY                   1
+
+/**
+ * Entry byte with the record data offset.
+ */
+#define ENTRY_OFFSET                2
+
+/**
+ * The first entry byte with record data.
+ */
+#define ENTRY_VALUE                 3
+
+/**
+ * Entry byte with the checksum.
+ */
+#define ENTRY_CHKSUM                7
+
+/**
+ * Key flag for the first entry of a snapshot.
+ */
+#define KEY_SNAPSHOT                0x80
+
+/**
+ * Returns the number of D-Flash bytes required to store record data.
+ *
+ * @param count
+ *	The number of record data bytes
+ */
+#define ENTRY_BYTES(count)          (((count) + ENTRY_DATA - 1) / ENTRY_DATA * ENTRY_SIZE)
+
+/**
+ * Checks whether a state belongs to a write.
+ *
+ * @param state
+ *	The state to check
+ */
+#define STATE_WRITING(state) \
+	(((state) >= STATE_REQUEST && (state) < STATE_DETECT) \
+	 || ((state) >= STATE_WRITE && (state) < STATE_DELETE))
+
+/**
+ * Marks a record without data in the D-Flash.
+ */
+#define BASE_NONE                   0xffff
+
+/**
+ * Marks an invalid entry or the absence of a record.
+ */
+#define RECORD_NONE                 0xff
+
 /** \var flash
  * Holds the persistence configuration.
  */
@@ -426,9 +519,16 @@ static volatile struct {
 
 	/**
 	 * The size of the data structure to persist.
+	 *
+	 * The record store uses the entry size.
 	 */
 	uword size;
 
+	/**
+	 * The end of the xdata to write.
+	 */
+	ubyte xdata * end;
+
 	/**
 	 * The useable amount of D-Flash.
 	 */
@@ -469,6 +569,22 @@ static volatile struct {
 	 * The current state of the flash ISR state machine.
 	 */
 	ubyte state;
+
+	/**
+	 * The number of records in the record store, 0 when a struct is
+	 * persisted.
+	 */
+	ubyte records;
+
+	/**
+	 * Set by the record store when the oldest page may be deleted.
+	 */
+	ubyte reclaim;
+
+	/**
+	 * Set while a write requested with hsk_flash_request() is pending.
+	 */
+	ubyte pending;
 } pdata flash;
 
 /**
@@ -485,6 +601,31 @@ static volatile ubyte code * xdata flashDptr;
  */
 static volatile ubyte xdata * xdata xdataDptr;
 
+/** \var store
+ * Holds the record store configuration.
+ */
+static struct {
+	/**
+	 * The record table.
+	 */
+	const hsk_flash_record code * records;
+
+	/**
+	 * The base of every record, see \ref flash_entries.
+	 */
+	uword base[FLASH_RECORDS];
+
+	/**
+	 * The free space that is kept to compact all records.
+	 */
+	uword reserve;
+
+	/**
+	 * The entries to write.
+	 */
+	ubyte buffer[ENTRY_BYTES(FLASH_RECORD_MAX)];
+} xdata store;
+
 /**
  * Flash delete/write state machine.
  *
@@ -502,6 +643,8 @@ static volatile ubyte xdata * xdata xdataDptr;
 #pragma nooverlay
 #endif
 void hsk_flash_isr_nmiflash(void) using 2 {
+	uword pos;
+
 	SET_RMAP();
 
 	switch(flash.state) {
@@ -563,15 +706,50 @@ void hsk_flash_isr_nmiflash(void) using 2 {
 		goto state_write;
 		break;
 	/**
-	 * - \ref STATE_DETECT checks whether there is a page that should be
-	 *   deleted.
+	 * - \ref STATE_DETECT starts a pending write if there is space and
+	 *   checks whether there is a page that should be deleted.
 	 *
-	 *   It either goes into \ref STATE_DELETE or \ref STATE_IDLE.
+	 *   It either goes into \ref STATE_WRITE, \ref STATE_DELETE or
+	 *   \ref STATE_IDLE.
 	 */
 	case STATE_DETECT:
 		/* Turn off the timer. */
 		FCS &= ~(1 << BIT_FTEN);
 
+		/* The record store only deletes pages set for reclaim. */
+		if (flash.records) {
+			if (flash.reclaim) {
+				flashDptr = dflash + flash.oldest;
+				goto state_delete;
+			}
+			flash.state = STATE_IDLE;
+			break;
+		}
+
+		/* Start a pending write, if there is space up to the
+		 * oldest data. */
+		if (flash.pending && flash.free != FREE_NONE) {
+			pos = flash.latest;
+			if (flash.free == FREE_BEHIND) {
+				pos += flash.size;
+				if (pos >= flash.wrap) {
+					pos = 0;
+				}
+			}
+			if (flash.free == FREE_LATEST || (flash.oldest >= pos ? \
+					flash.oldest - pos : \
+					flash.wrap + flash.oldest - pos) >= flash.size) {
+				flash.pending = 0;
+				flash.latest = pos;
+				xdataDptr = flash.ptr;
+				flashDptr = dflash + pos;
+				/* Set program flash timer mode, 5µs for an
+				 * overflow. */
+				FTVAL &= ~(1 << BIT_MODE);
+				goto state_write;
+			}
+		}
+
 		switch (flash.free) {
 		case FREE_NONE:
 			flashDptr = dflash + flash.oldest;
@@ -748,7 +926,7 @@ __endasm;
 		/* 9.
 		 * Repeat steps 6 to 8 for any further programming of data to
 		 * the same row. */
-		if (xdataDptr < &flash.ptr[flash.size] && (flashDptr - dflash) % BYTES_WORDLINE_DFLASH != 0) {
+		if (xdataDptr < flash.end && (flashDptr - dflash) % BYTES_WORDLINE_DFLASH != 0) {
 			goto state_write_loop;
 		}
 
@@ -768,10 +946,14 @@ __endasm;
 		/* 13.
 		 * Delay for a minimum of 1 us (Trcv). */
 		/* Actually just wait for the completion of another 5µs. */
-		if (xdataDptr < &flash.ptr[flash.size]) {
+		if (xdataDptr < flash.end) {
 			/* Still something left to write, start with a
 			 * new wordline. */
 			flash.state = STATE_WRITE;
+			/* Record store writes may wrap around. */
+			if (flashDptr - dflash >= flash.wrap) {
+				flashDptr = dflash;
+			}
 		} else {
 			/* Write completed. */
 			flash.state = STATE_DETECT;
@@ -879,6 +1061,8 @@ __endasm;
 		if (flash.free == FREE_NONE && flash.oldest >= flash.size) {
 			flash.free = FREE_LATEST;
 		}
+		/* The page set for reclaim is gone. */
+		flash.reclaim = 0;
 		flash.state = STATE_DETECT;
 		break;
 	/**
@@ -977,30 +1161,90 @@ __endasm;
 }
 #pragma restore
 
-ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
-		const ubyte __xdata version) {
+/**
+ * Updates the checksum of the data structure to persist.
+ *
+ * It is the simple checksum used in the Intel HEX (.ihx) file format.
+ *
+ * @private
+ */
+void hsk_flash_chksum(void) {
 	uword i;
-	ubyte chksum;
+	ubyte chksum = 0;
 
-	/* Setup the xdata area to persist. */
-	flash.ptr = ptr;
-	flash.size = size;
-	flash.wrap = (sizeof(dflash) / size) * size;
-	flash.ident = (version & 0x3f) | 0x40;
-	flashDptr = 0;
-	xdataDptr = 0;
+	for (i = 0; i < flash.size - 1; i++) {
+		chksum += flash.ptr[i];
+	}
+	flash.ptr[flash.size - 1] = -chksum;
+}
 
-	/* Set up the NMIFLASH ISR. */
-	hsk_isr14.NMIFLASH = &hsk_flash_isr_nmiflash;
+/**
+ * Locates the latest data and the oldest page using the block prefixes.
+ *
+ * Every block written starts with the ident and the free space behind
+ * the latest block is erased, so only the first byte of every block has
+ * to be read to find the latest block. Only the free space behind the
+ * latest block is read entirely, the oldest data is the first byte that
+ * is not 0xff, which is what hsk_flash_scan() looks for as well. Used
+ * pages may contain 0xff bytes, so they cannot be told apart from free
+ * pages by their content.
+ *
+ * @retval 1
+ *	The data was located
+ * @retval 0
+ *	The block prefixes are inconsistent, the D-Flash has to be scanned
+ * @private
+ */
+bool hsk_flash_index(void) {
+	uword pos, next;
+	uword found = flash.wrap;
 
-	#define ptr       flash.ptr
+	/* Find the only used block followed by a free block. */
+	for (pos = 0; pos < flash.wrap; pos += flash.size) {
+		next = pos + flash.size < flash.wrap ? pos + flash.size : 0;
+		if (dflash[pos] != 0xff && dflash[next] == 0xff) {
+			if (found != flash.wrap) {
+				return 0;
+			}
+			found = pos;
+		}
+	}
+	if (found == flash.wrap) {
+		return 0;
+	}
+
+	/* The block behind must be entirely free. */
+	next = found + flash.size < flash.wrap ? found + flash.size : 0;
+	for (pos = 0; pos < flash.size; pos++) {
+		if (dflash[next + pos] != 0xff) {
+			return 0;
+		}
+	}
+
+	/* Walk right over the free space, seek the oldest data. */
+	for (pos = (next + flash.size) % flash.wrap;
+		dflash[pos] == 0xff && pos != found;
+		pos = (pos + 1) % flash.wrap);
+	/* Align to the beginning of the page. */
+	flash.oldest = pos - (pos % BYTES_PAGE_DFLASH);
+
+	flash.latest = found;
+	flash.free = FREE_BEHIND;
+	return 1;
+}
+
+/**
+ * Locates the latest data, the oldest data and free space by scanning the
+ * entire D-Flash.
+ *
+ * @private
+ */
+void hsk_flash_scan(void) {
 	#define size      flash.size
 	#define oldest    flash.oldest
 	#define wrap      flash.wrap
 	#define latest    flash.latest
 	#define free      flash.free
-	#define state     flash.state
-	#define ident     flash.ident
 	/* Find an unused block. */
 	free = FREE_NONE;
 	for (oldest = 0; oldest < wrap; oldest++) {
@@ -1023,22 +1267,7 @@ ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
 	if (oldest >= wrap) {
 		oldest = 0;
 		latest = 0;
-		/* Kick off the ISR, start to delete. */
-		state = STATE_DETECT;
-		NMICON |= 1 << BIT_NMIFLASH;
-		SET_RMAP();
-		FCS |= 1 << BIT_FTEN;
-		RESET_RMAP();
-
-		/* Check whether XRAM data is consistent. */
-		if (ptr[0] == ident) {
-			return 1;
-		}
-
-		/* Setup data envelope. */
-		memset(ptr, 0, size);
-		ptr[0] = ident;
-		return 0;
+		return;
 	}
 
 	/* Walk left, seek the newest data. */
@@ -1061,8 +1290,46 @@ ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
 		oldest = (oldest + 1) % wrap);
 	/* Align to the beginning of the page. */
 	oldest = oldest - (oldest % BYTES_PAGE_DFLASH);
+	#undef size
+	#undef oldest
+	#undef wrap
+	#undef latest
+	#undef free
+}
 
-	/* Kick off the ISR, in case there is something to delete. */
+ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
+		const ubyte __xdata version) {
+	uword i;
+	ubyte chksum;
+
+	/* Setup the xdata area to persist. */
+	flash.ptr = ptr;
+	flash.size = size;
+	flash.end = flash.ptr + size;
+	flash.wrap = (sizeof(dflash) / size) * size;
+	flash.ident = IDENT(version);
+	flash.records = 0;
+	flash.reclaim = 0;
+	flash.pending = 0;
+	flashDptr = 0;
+	xdataDptr = 0;
+
+	/* Set up the NMIFLASH ISR. */
+	hsk_isr14.NMIFLASH = &hsk_flash_isr_nmiflash;
+
+	/* Locate the data, scan the entire D-Flash if that fails. */
+	if (!hsk_flash_index()) {
+		hsk_flash_scan();
+	}
+
+	#define ptr       flash.ptr
+	#define size      flash.size
+	#define latest    flash.latest
+	#define free      flash.free
+	#define state     flash.state
+	#define ident     flash.ident
+	/* Kick off the ISR, in case there is something to delete. If there
+	 * are no free blocks at all, this starts to delete. */
 	state = STATE_DETECT;
 	NMICON |= 1 << BIT_NMIFLASH;
 	SET_RMAP();
@@ -1071,6 +1338,8 @@ ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
 
 	/* Check whether XRAM data is consistent. */
 	if (ptr[0] == ident) {
+		/* Members may have been changed without hsk_flash_set(). */
+		hsk_flash_chksum();
 		return 1;
 	}
 
@@ -1078,10 +1347,11 @@ ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
 	 * Restore data from the D-Flash.
 	 */
 	/* Validate the prefix. */
-	if (dflash[latest] != ident) {
+	if (free == FREE_NONE || dflash[latest] != ident) {
 		/* Setup data envelope. */
 		memset(ptr, 0, size);
 		ptr[0] = ident;
+		ptr[size - 1] = -ident;
 		return 0;
 	}
 	/* Validate the data checksum. It is the simple checksum used in the
@@ -1095,6 +1365,7 @@ ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
 		/* Setup data envelope. */
 		memset(ptr, 0, size);
 		ptr[0] = ident;
+		ptr[size - 1] = -ident;
 		return 0;
 	}
 
@@ -1105,18 +1376,52 @@ ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
 	return 2;
 	#undef ptr
 	#undef size
-	#undef oldest
-	#undef wrap
 	#undef latest
 	#undef free
 	#undef state
 	#undef ident
 }
 
-bool hsk_flash_write(void) {
-	uword i;
-	ubyte chksum;
+/**
+ * Stops the flash timer, so a write can be set up.
+ *
+ * The flash NMI has to be turned off when calling this, it is turned back
+ * on once the timer is stopped.
+ *
+ * @private
+ */
+void hsk_flash_halt(void) {
+	/* Return the flash timer to the default state (5µs cycle, off). */
+	SET_RMAP();
+	FCS &= ~(1 << BIT_FTEN);
+	FTVAL = 120 << BIT_OFVAL;
+	RESET_RMAP();
+	/* Now that the interrupt generating clock is turned off, it is safe
+	 * to reactivate the interrupt. */
+	NMICON |= 1 << BIT_NMIFLASH;
+}
 
+/**
+ * Starts writing the data set up in \ref xdataDptr and \ref flashDptr.
+ *
+ * @private
+ */
+void hsk_flash_start(void) {
+	/*
+	 * Resume operation from the appropriate state.
+	 */
+	if (flash.state == STATE_IDLE) {
+		flash.state = STATE_WRITE;
+	} else {
+		flash.state = STATE_REQUEST;
+	}
+	SET_RMAP();
+	FTVAL = 120 << BIT_OFVAL;
+	FCS |= 1 << BIT_FTEN;
+	RESET_RMAP();
+}
+
+bool hsk_flash_write(void) {
 	/* Turn off the state machine, because that's the only way to
 	 * safely access the hsk_flash struct. */
 	NMICON &= ~(1 << BIT_NMIFLASH);
@@ -1146,14 +1451,7 @@ bool hsk_flash_write(void) {
 	/*
 	 * Prepare to abort current operation.
 	 */
-	/* Return the flash timer to the default state (5µs cycle, off). */
-	SET_RMAP();
-	FCS &= ~(1 << BIT_FTEN);
-	FTVAL = 120 << BIT_OFVAL;
-	RESET_RMAP();
-	/* Now that the interrupt generating clock is turned off, it is safe
-	 * to reactivate the interrupt. */
-	NMICON |= 1 << BIT_NMIFLASH;
+	hsk_flash_halt();
 
 	/*
 	 * Update pointers for writing.
@@ -1167,25 +1465,343 @@ bool hsk_flash_write(void) {
 	/*
 	 * Create chksum.
 	 */
+	hsk_flash_chksum();
+
+	/* This write supersedes a pending one. */
+	flash.pending = 0;
+	hsk_flash_start();
+	return 1;
+}
+
+void hsk_flash_set(ubyte xdata * const member, const ubyte value) {
+	/* Turn off the state machine, because that's the only way to
+	 * safely access the hsk_flash struct. */
+	NMICON &= ~(1 << BIT_NMIFLASH);
+
+	/* Update the checksum. */
+	flash.ptr[flash.size - 1] += *member - value;
+	*member = value;
+
+	/* The ongoing write may have stored the old value, write again. */
+	if (STATE_WRITING(flash.state)) {
+		flash.pending = 1;
+	}
+
+	NMICON |= 1 << BIT_NMIFLASH;
+}
+
+void hsk_flash_request(void) {
+	/* The state machine checks the pending flag before going to sleep,
+	 * so it only needs to be woken up if it is already asleep. And
+	 * while it sleeps the flash timer is off, so it is safe to access
+	 * the hsk_flash struct. */
+	flash.pending = 1;
+	if (flash.state == STATE_IDLE) {
+		flash.state = STATE_DETECT;
+		SET_RMAP();
+		FTVAL = 120 << BIT_OFVAL;
+		FCS |= 1 << BIT_FTEN;
+		RESET_RMAP();
+	}
+}
+
+ubyte hsk_flash_status(void) {
+	if (flash.pending) {
+		return FLASH_STATUS_PENDING;
+	}
+	if (STATE_WRITING(flash.state)) {
+		return FLASH_STATUS_WRITE;
+	}
+	return FLASH_STATUS_IDLE;
+}
+
+/**
+ * Validates a record store entry.
+ *
+ * @param pos
+ *	The position of the entry in the D-Flash
+ * @return
+ *	The key of the record the entry belongs to or RECORD_NONE
+ * @private
+ */
+ubyte hsk_flash_entry(const uword pos) {
+	ubyte record = dflash[pos + ENTRY_KEY] & ~KEY_SNAPSHOT;
+	ubyte chksum;
+	ubyte i;
+
+	if (record >= flash.records || dflash[pos + ENTRY_IDENT]
+	    != IDENT(store.records[record].version)) {
+		return RECORD_NONE;
+	}
+	/* Validate the checksum, same as for the struct. */
 	chksum = 0;
-	for (i = 0; i < flash.size - 1; i++) {
-		chksum += flash.ptr[i];
+	for (i = 0; i < ENTRY_CHKSUM; i++) {
+		chksum += dflash[pos + i];
 	}
 	chksum = -chksum;
-	flash.ptr[flash.size - 1] = chksum;
+	if (dflash[pos + ENTRY_CHKSUM] != chksum) {
+		return RECORD_NONE;
+	}
+	return record;
+}
+
+/**
+ * Checks whether a snapshot was completely written.
+ *
+ * @param pos
+ *	The position of the first entry of the snapshot
+ * @param record
+ *	The key of the record
+ * @retval 1
+ *	The snapshot covers the entire record
+ * @retval 0
+ *	The snapshot is incomplete
+ * @private
+ */
+bool hsk_flash_snapshot(uword pos, const ubyte record) {
+	ubyte offset;
+
+	for (offset = 0; offset < store.records[record].size;
+	     offset += ENTRY_DATA) {
+		if (hsk_flash_entry(pos) != record
+		    || dflash[pos + ENTRY_OFFSET] != offset) {
+			return 0;
+		}
+		pos = (pos + ENTRY_SIZE) % flash.wrap;
+	}
+	return 1;
+}
+
+ubyte hsk_flash_records_init(const hsk_flash_record code * const records,
+                             const ubyte count) {
+	uword pos, start, run, length;
+	ubyte record, i;
+	ubyte result = FLASH_PWR_FIRST;
+
+	/* Setup the record store. */
+	store.records = records;
+	store.reserve = BYTES_PAGE_DFLASH;
+	flash.records = count > FLASH_RECORDS ? FLASH_RECORDS : count;
+	flash.size = ENTRY_SIZE;
+	flash.wrap = sizeof(dflash);
+	flash.free = FREE_BEHIND;
+	flash.reclaim = 0;
+	flash.pending = 0;
+	flash.state = STATE_IDLE;
+	flashDptr = 0;
+	xdataDptr = 0;
+	for (record = 0; record < flash.records; record++) {
+		memset(records[record].ptr, 0, records[record].size);
+		store.base[record] = BASE_NONE;
+		store.reserve += ENTRY_BYTES(records[record].size);
+	}
+
+	/* Set up the NMIFLASH ISR. */
+	hsk_isr14.NMIFLASH = &hsk_flash_isr_nmiflash;
+	NMICON |= 1 << BIT_NMIFLASH;
+
+	/* Find a used entry. */
+	for (start = 0; start < flash.wrap && dflash[start] == 0xff;
+	     start += ENTRY_SIZE);
+	/* No data at all in the flash. */
+	if (start >= flash.wrap) {
+		flash.oldest = 0;
+		flash.latest = 0;
+		return FLASH_PWR_FIRST;
+	}
+
+	/* Seek the longest run of free entries, it is followed by the
+	 * oldest data. */
+	length = 0;
+	run = 0;
+	pos = start;
+	do {
+		pos = (pos + ENTRY_SIZE) % flash.wrap;
+		if (dflash[pos] == 0xff) {
+			run += ENTRY_SIZE;
+			if (run > length) {
+				length = run;
+				flash.latest = (flash.wrap + pos + ENTRY_SIZE - run) % flash.wrap;
+			}
+		} else {
+			run = 0;
+		}
+	} while (pos != start);
+	/* Align to the beginning of the page. */
+	flash.oldest = (flash.latest + length) % flash.wrap;
+	flash.oldest -= flash.oldest % BYTES_PAGE_DFLASH;
+
+	/* Pages are deleted as a whole, so the free space must end on a
+	 * page boundary. Otherwise the D-Flash is corrupted and has to be
+	 * mass erased. */
+	if (!length || (flash.latest + length) % BYTES_PAGE_DFLASH) {
+		flash.oldest = 0;
+		flash.latest = 0;
+		flash.state = STATE_RESET;
+		SET_RMAP();
+		FTVAL = 120 << BIT_OFVAL;
+		FCS |= 1 << BIT_FTEN;
+		RESET_RMAP();
+		return FLASH_PWR_FIRST;
+	}
 
 	/*
-	 * Resume operation from the appropriate state.
+	 * Restore the records from the oldest to the latest entry.
 	 */
-	if (flash.state == STATE_IDLE) {
-		flash.state = STATE_WRITE;
-	} else {
-		flash.state = STATE_REQUEST;
+	for (pos = flash.oldest; pos != flash.latest;
+	     pos = (pos + ENTRY_SIZE) % flash.wrap) {
+		record = hsk_flash_entry(pos);
+		if (record == RECORD_NONE) {
+			continue;
+		}
+		#define rec     records[record]
+		#define offset  dflash[pos + ENTRY_OFFSET]
+		/* Update the base. */
+		if (store.base[record] == BASE_NONE
+		    || ((dflash[pos + ENTRY_KEY] & KEY_SNAPSHOT)
+		        && hsk_flash_snapshot(pos, record))) {
+			store.base[record] = pos;
+		}
+		/* Copy data from the D-Flash to the xram. */
+		for (i = 0; i < ENTRY_DATA && offset + i < rec.size; i++) {
+			((ubyte xdata *)rec.ptr)[offset + i] = dflash[pos + ENTRY_VALUE + i];
+		}
+		#undef rec
+		#undef offset
+		result = FLASH_PWR_ON;
 	}
-	SET_RMAP();
-	FTVAL = 120 << BIT_OFVAL;
-	FCS |= 1 << BIT_FTEN;
-	RESET_RMAP();
-	return 1;
+	return result;
+}
+
+/**
+ * Fills the write buffer with record entries and sets up the write.
+ *
+ * @param record
+ *	The key of the record
+ * @param offset
+ *	The offset of the first byte to write
+ * @param count
+ *	The number of bytes to write
+ * @param key
+ *	The key byte of the first entry
+ * @private
+ */
+void hsk_flash_record_stage(const ubyte record, ubyte offset,
+                            const ubyte count, ubyte key) {
+	ubyte xdata * const ptr = store.records[record].ptr;
+	const ubyte size = store.records[record].size;
+	const ubyte end = offset + count;
+	ubyte xdata * entry = store.buffer;
+	ubyte i, chksum;
+
+	for (; offset < end; offset += ENTRY_DATA) {
+		entry[ENTRY_IDENT] = IDENT(store.records[record].version);
+		entry[ENTRY_KEY] = key;
+		entry[ENTRY_OFFSET] = offset;
+		for (i = 0; i < ENTRY_DATA; i++) {
+			entry[ENTRY_VALUE + i] = offset + i < size ? ptr[offset + i] : 0xff;
+		}
+		chksum = 0;
+		for (i = 0; i < ENTRY_CHKSUM; i++) {
+			chksum += entry[i];
+		}
+		entry[ENTRY_CHKSUM] = -chksum;
+		key &= ~KEY_SNAPSHOT;
+		entry += ENTRY_SIZE;
+	}
+
+	/*
+	 * Update pointers for writing.
+	 */
+	xdataDptr = store.buffer;
+	flash.end = entry;
+	flashDptr = dflash + flash.latest;
+	flash.latest = (flash.latest + (entry - store.buffer)) % flash.wrap;
+}
+
+ubyte hsk_flash_record_write(const ubyte record, const ubyte offset,
+                             const ubyte count) {
+	uword space;
+	ubyte compact;
+
+	/* The range has to be within the record, the record within the
+	 * staging buffer. */
+	if (record >= flash.records || count > FLASH_RECORD_MAX
+	    || (uword)offset + count > store.records[record].size) {
+		return FLASH_RECORD_INVALID;
+	}
+	if (!count) {
+		return FLASH_RECORD_WRITE;
+	}
+
+	/* Turn off the state machine, because that's the only way to
+	 * safely access the hsk_flash struct. */
+	NMICON &= ~(1 << BIT_NMIFLASH);
+
+	/* Only deletes may be interrupted, an aborted write would lose
+	 * data. */
+	if (flash.state != STATE_IDLE && flash.state != STATE_DETECT
+	    && (flash.state < STATE_DELETE || flash.state >= STATE_RESET)) {
+		NMICON |= 1 << BIT_NMIFLASH;
+		return FLASH_RECORD_BUSY;
+	}
+
+	/*
+	 * Check for sufficient free space in the D-Flash, the reserve
+	 * is kept for compacting.
+	 */
+	space = flash.wrap - (flash.wrap + flash.latest - flash.oldest) % flash.wrap;
+	if (space < ENTRY_BYTES(count) + store.reserve) {
+		/* Find a record that still depends on the oldest page. */
+		for (compact = 0; compact < flash.records; compact++) {
+			if (store.base[compact] != BASE_NONE
+			    && (flash.wrap + store.base[compact] - flash.oldest)
+			       % flash.wrap < BYTES_PAGE_DFLASH) {
+				break;
+			}
+		}
+
+		/* The oldest page is no longer required, delete it. */
+		if (compact >= flash.records) {
+			flash.reclaim = 1;
+			if (flash.state == STATE_IDLE) {
+				flash.state = STATE_DETECT;
+				SET_RMAP();
+				FTVAL = 120 << BIT_OFVAL;
+				FCS |= 1 << BIT_FTEN;
+				RESET_RMAP();
+			}
+			NMICON |= 1 << BIT_NMIFLASH;
+			return FLASH_RECORD_BUSY;
+		}
+
+		/* Not even the reserve is left. */
+		if (space <= ENTRY_BYTES(store.records[compact].size)) {
+			NMICON |= 1 << BIT_NMIFLASH;
+			return FLASH_RECORD_BUSY;
+		}
+
+		/* Compact the record by writing a snapshot. */
+		hsk_flash_halt();
+		store.base[compact] = flash.latest;
+		hsk_flash_record_stage(compact, 0, store.records[compact].size,
+		                       compact | KEY_SNAPSHOT);
+		hsk_flash_start();
+		/* The snapshot contains the changes. */
+		return compact == record ? FLASH_RECORD_WRITE : FLASH_RECORD_BUSY;
+	}
+
+	/*
+	 * Prepare to abort current operation.
+	 */
+	hsk_flash_halt();
+
+	/* Write a delta. */
+	if (store.base[record] == BASE_NONE) {
+		store.base[record] = flash.latest;
+	}
+	hsk_flash_record_stage(record, offset, count, record);
+	hsk_flash_start();
+	return FLASH_RECORD_WRITE;
 }
 
@@ -82,6 +82,24 @@
  *
  * An advantage would be that less memory is required, because data
  * no longer needs to be byte aligned.
+ *
+ * \section flash_records Record Store
+ *
+ * As an alternative to a single struct, the D-Flash can hold a store of
+ * up to \ref FLASH_RECORDS independently versioned records, set up with
+ * hsk_flash_records_init().
+ *
+ * Instead of rewriting a whole record, hsk_flash_record_write() appends
+ * delta entries for the changed bytes. Every entry takes 8 bytes of
+ * D-Flash and carries up to 4 bytes of record data, so frequently
+ * changing counters can be stored without rewriting calibration data.
+ *
+ * Pages are only deleted when the free space runs low. Before a page is
+ * deleted, records that still depend on its contents are compacted, i.e.
+ * rewritten as a whole.
+ *
+ * The struct and the record store cannot be used at the same time,
+ * because they use different D-Flash formats.
  */
 
 #ifndef _HSK_PERSIST_H_
@@ -189,6 +207,10 @@
  * recovered from flash, if previously stored there. After a simple reset the
  * data can still be found in XRAM and recovery can be sped up.
  *
+ * To locate the data in the D-Flash only the first byte of every block
+ * is read. The entire D-Flash is only scanned if the blocks are found to
+ * be inconsistent.
+ *
  * If recovery fails entirely all members of the struct will be set to 0.
  *
  * @param version
@@ -221,5 +243,155 @@ ubyte hsk_flash_init(void xdata * const ptr, const uword __xdata size,
  */
 bool hsk_flash_write(void);
 
+/**
+ * Returned by hsk_flash_status() when all requested writes are complete.
+ */
+#define FLASH_STATUS_IDLE     0
+
+/**
+ * Returned by hsk_flash_status() when a write request is waiting for
+ * free D-Flash space or for the completion of an ongoing write.
+ */
+#define FLASH_STATUS_PENDING  1
+
+/**
+ * Returned by hsk_flash_status() while a write is on the way.
+ */
+#define FLASH_STATUS_WRITE    2
+
+/**
+ * Changes a byte of the persisted struct and updates the checksum.
+ *
+ * Writes requested with hsk_flash_request() use the checksum updated by
+ * this function. A change during an ongoing write requests another write.
+ *
+ * @param member
+ *	A pointer to the byte to change
+ * @param value
+ *	The new value
+ */
+void hsk_flash_set(ubyte xdata * const member, const ubyte value);
+
+/**
+ * Requests writing the current data to the D-Flash.
+ *
+ * Unlike hsk_flash_write() the request is always accepted. The write is
+ * started by the flash state machine as soon as ongoing writes are
+ * complete and enough free D-Flash space is available. Repeated requests
+ * before the write starts result in a single write of the latest data.
+ *
+ * The struct members have to be changed with hsk_flash_set(), because
+ * the checksum is not recalculated. Members changed directly have to be
+ * written with hsk_flash_write().
+ */
+void hsk_flash_request(void);
+
+/**
+ * Returns the state of requested writes.
+ *
+ * @retval FLASH_STATUS_IDLE
+ *	All requested writes are complete
+ * @retval FLASH_STATUS_PENDING
+ *	A write request is pending
+ * @retval FLASH_STATUS_WRITE
+ *	A write is on the way
+ */
+ubyte hsk_flash_status(void);
+
+/**
+ * The maximum number of records in the record store.
+ */
+#define FLASH_RECORDS      8
+
+/**
+ * The maximum size of a record in bytes.
+ */
+#define FLASH_RECORD_MAX   64
+
+/**
+ * Returned by hsk_flash_record_write() when the D-Flash is busy or there
+ * is not enough free D-Flash space, the write has to be repeated.
+ */
+#define FLASH_RECORD_BUSY     0
+
+/**
+ * Returned by hsk_flash_record_write() when the write is on the way.
+ */
+#define FLASH_RECORD_WRITE    1
+
+/**
+ * Returned by hsk_flash_record_write() when the record does not exist or
+ * the range is not within the record, repeating the write is futile.
+ */
+#define FLASH_RECORD_INVALID  2
+
+/**
+ * A record definition for the record store.
+ *
+ * The byte order considerations from \ref flash_byte_order apply.
+ */
+typedef struct {
+	/**
+	 * A pointer to the xdata struct/array to persist.
+	 */
+	void xdata * ptr;
+
+	/**
+	 * The size of the record, up to FLASH_RECORD_MAX bytes.
+	 */
+	ubyte size;
+
+	/**
+	 * Version number of the record layout, used to prevent
+	 * initialization with incompatible data.
+	 */
+	ubyte version;
+} hsk_flash_record;
+
+/**
+ * Sets up the D-Flash record store and recovers the records from the
+ * D-Flash.
+ *
+ * Records that cannot be recovered are set to 0.
+ *
+ * @param records
+ *	The record table, the index of a record is its key
+ * @param count
+ *	The number of records, up to FLASH_RECORDS
+ * @retval FLASH_PWR_FIRST
+ *	No valid data was recovered
+ * @retval FLASH_PWR_ON
+ *	Data of at least one record was recovered
+ */
+ubyte hsk_flash_records_init(const hsk_flash_record code * const records,
+                             const ubyte count);
+
+/**
+ * Writes changed bytes of a record to the D-Flash.
+ *
+ * Ongoing deletes are interrupted unless there is insufficient space left
+ * to write the data. Ongoing writes are not interrupted.
+ *
+ * When the free space runs low, a call may be used to compact a different
+ * record, in that case the write has to be repeated.
+ *
+ * @param record
+ *	The key of the record
+ * @param offset
+ *	The offset of the first changed byte
+ * @param count
+ *	The number of changed bytes, the range must be within the record
+ * @retval FLASH_RECORD_BUSY
+ *	The D-Flash is busy or not enough free D-Flash space to write, the
+ *	caller must retry later
+ * @retval FLASH_RECORD_WRITE
+ *	The D-Flash write is on the way
+ * @retval FLASH_RECORD_INVALID
+ *	The record does not exist or the range exceeds it, nothing is
+ *	written
+ */
+ubyte hsk_flash_record_write(const ubyte record, const ubyte offset,
+                             const ubyte count);
+
 #endif /* _HSK_PERSIST_H_ */
 
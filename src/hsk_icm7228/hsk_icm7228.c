@@ -57,6 +57,16 @@ static const ubyte code codepage[] = {
  */
 #define ILLUMINATE_OFFSET	16
 
+/**
+ * The number of decimal digits of a uword.
+ */
+#define DEC_DIGITS	5
+
+/**
+ * The decimal digit values of a uword.
+ */
+static const uword code powers[] = {1, 10, 100, 1000, 10000};
+
 void hsk_icm7228_writeString(ubyte xdata * const buffer,
 		char const * str, ubyte pos, ubyte len) {
 	while (len > 0 && str[0]) {
@@ -74,13 +84,34 @@ void hsk_icm7228_writeString(ubyte xdata * const buffer,
 void hsk_icm7228_writeDec(ubyte xdata * const buffer, uword value,
                           char power, ubyte const pos, ubyte len) {
 	ubyte point = power ? 0x7f : 0xff;
+	ubyte digits[DEC_DIGITS];
+	ubyte count = 0;
+	ubyte i;
 
-	while (len > 0) {
-		buffer[pos + --len] = (value || power <= 0) ? codepage[value % 10] : codepage[' '] ;
+	/*
+	 * Convert to BCD by subtracting the digit values, 16 bit divisions
+	 * are expensive. Count the significant digits on the way.
+	 */
+	for (i = DEC_DIGITS - 1; i > 0; i--) {
+		digits[i] = 0;
+		while (value >= powers[i]) {
+			value -= powers[i];
+			digits[i]++;
+		}
+		if (!count && digits[i]) {
+			count = i + 1;
+		}
+	}
+	digits[0] = value;
+	if (!count && value) {
+		count = 1;
+	}
+
+	for (i = 0; len > 0; i++) {
+		buffer[pos + --len] = (i < count || power <= 0) ? codepage[i < DEC_DIGITS ? digits[i] : 0] : codepage[' '] ;
 		if (power++ == 0) {
 			buffer[pos + len] &= point;
 		}
-		value /= 10;
 	}
 }
 
@@ -23,7 +23,7 @@
  * - void \<prefix\>_init(void)
  *	- Initialize the buffer and I/O register bits
  * - void \<prefix\>_refresh(void)
- *	- Commit buffered data to the 7 segment displays
+ *	- Commit buffered data to the 7 segment displays, if it changed
  * - void \<prefix\>_writeString(char * str, ubyte pos, ubyte len)
  *	- Wrapper around hsk_icm7228_writeString()
  * - void \<prefix\>_writeDec(uword value, char power, ubyte pos, ubyte len)
@@ -53,6 +53,21 @@
 	 */\
 	ubyte xdata prefix##_buffer[8]; \
 	\
+	/**
+	 * The data last written to the display driver at I/O port regData.
+	 *
+	 * @see ICM7228_FACTORY
+	 */\
+	ubyte xdata prefix##_shadow[8]; \
+	\
+	/**
+	 * Set if the display driver at I/O port regData has not been written
+	 * since the last init.
+	 *
+	 * @see ICM7228_FACTORY
+	 */\
+	bool prefix##_stale; \
+	\
 	/**
 	 * Set up buffer and ports for display driver at I/O port regData.
 	 *
@@ -60,6 +75,7 @@
 	 */\
 	void prefix##_init(void) { \
 		memset(prefix##_buffer, 0, sizeof(prefix##_buffer)); \
+		prefix##_stale = 1; \
 	\
 		regMode##_DIR |= 1 << bitMode; \
 		regWrite##_DIR |= 1 << bitWrite; \
@@ -69,10 +85,24 @@
 	/**
 	 * Reflesh displays at I/O port regData with the buffered data.
 	 *
+	 * Nothing is written if the buffer did not change since the last
+	 * refresh.
+	 *
 	 * @see ICM7228_FACTORY
 	 */\
 	void prefix##_refresh(void) { \
 		ubyte i; \
+	\
+		/* Skip unchanged displays. */ \
+		for (i = 0; !prefix##_stale && i < 8; i++) { \
+			if (prefix##_buffer[i] != prefix##_shadow[i]) { \
+				break; \
+			} \
+		} \
+		if (i >= 8) { \
+			return; \
+		} \
+		prefix##_stale = 0; \
 	\
 		/* Select write to control register. */ \
 		regMode##_DATA |= 1 << bitMode; \
@@ -86,7 +116,8 @@
 		regMode##_DATA &= ~(1 << bitMode); \
 	\
 		for (i = 0; i < 8; i++) { \
-			regData##_DATA = prefix##_buffer[i]; \
+			prefix##_shadow[i] = prefix##_buffer[i]; \
+			regData##_DATA = prefix##_shadow[i]; \
 			regWrite##_DATA &= ~(1 << bitWrite); \
 			regWrite##_DATA |= 1 << bitWrite; \
 		} \
@@ -201,6 +232,8 @@ void hsk_icm7228_writeString(ubyte xdata * const buffer, \
  * I.e. the previous example with power = 1 would result in an encoding of
  * "012".
  *
+ * The conversion does not use divisions.
+ *
  * @param buffer
  *	The target buffer for the encoded string
  * @param value
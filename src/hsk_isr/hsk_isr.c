@@ -20,12 +20,266 @@
  * | 34         | ISR: Backup RMAP              | …             | 3 x 2 + 4
  * | 44         | ISR: Reset RMAP               | …             | 2 x 2 + 4
  * | 52         | ISR: Select callback          | …             | …
+ *
+ * \section isr_conf Shared ISR Configuration
+ *
+ * Only the interrupt sources that callbacks are registered for are
+ * compiled into the shared ISRs. The registered sources are listed in the
+ * header hsk_isr_conf.h, which is generated by the isrconf.awk script,
+ * by defining HSK_ISRn_SOURCE for every registered source. The "make
+ * isrconf" target only passes the sources linked into the binaries, so
+ * modules that are not linked do not enable their sources.
+ *
+ * The script detects the following registrations:
+ * - hsk_isrN.SOURCE = &callback;
+ * - hsk_isrN.SOURCE = callback;
+ * - Library functions registering callbacks, e.g. hsk_ex_channel_enable()
+ *
+ * Other forms, e.g. assignments through a pointer, are not detected. The
+ * sources they register have to be defined on the compiler command line,
+ * e.g. -DHSK_ISR5_TF2. Otherwise the events of these sources are dropped
+ * or, if they are not acknowledged by the ISR, retrigger forever.
+ *
+ * If the configuration header is missing (only detected by preprocessors
+ * supporting __has_include) or does not define HSK_ISR_CONF, all sources
+ * are compiled in.
+ *
+ * Sources that are expected to fire most frequently are checked first and
+ * sources sharing an SFR page are grouped to avoid page switches.
+ *
+ * Events of unregistered sources on IRCON0 and IRCON1 are acknowledged
+ * without a callback, other unregistered sources have to remain disabled.
  */
 
 #include <Infineon/XC878.h>
 
 #include "hsk_isr.h"
 
+#ifdef __has_include
+#if __has_include(<hsk_isr_conf.h>)
+#include <hsk_isr_conf.h>
+#endif
+#else
+#include <hsk_isr_conf.h>
+#endif
+
+/*
+ * Without a configuration compile every source.
+ */
+#ifndef HSK_ISR_CONF
+	#define HSK_ISR5_TF2
+	#define HSK_ISR5_EXF2
+	#define HSK_ISR5_CCTOVF
+	#define HSK_ISR5_NDOV
+	#define HSK_ISR5_EOFSYN
+	#define HSK_ISR5_ERRSYN
+	#define HSK_ISR5_CANSRC0
+	#define HSK_ISR6_CANSRC1
+	#define HSK_ISR6_CANSRC2
+	#define HSK_ISR6_ADCSR0
+	#define HSK_ISR6_ADCSR1
+	#define HSK_ISR8_EXINT2
+	#define HSK_ISR8_NDOV
+	#define HSK_ISR8_RI
+	#define HSK_ISR8_TI
+	#define HSK_ISR8_TF2
+	#define HSK_ISR8_EXF2
+	#define HSK_ISR8_EOC
+	#define HSK_ISR8_IRDY
+	#define HSK_ISR8_IERR
+	#define HSK_ISR9_EXINT3
+	#define HSK_ISR9_EXINT4
+	#define HSK_ISR9_EXINT5
+	#define HSK_ISR9_EXINT6
+	#define HSK_ISR9_T2CC
+	#define HSK_ISR9_CANSRC3
+#endif /* HSK_ISR_CONF */
+
+#ifdef HSK_ISR_STATS
+
+#include <string.h> /* memset() */
+
+/**
+ * Define run time statistics for ISR 5.
+ */
+volatile struct hsk_isr5_stats xdata hsk_isr5_stats;
+
+/**
+ * Define run time statistics for ISR 6.
+ */
+volatile struct hsk_isr6_stats xdata hsk_isr6_stats;
+
+/**
+ * Define run time statistics for ISR 8.
+ */
+volatile struct hsk_isr8_stats xdata hsk_isr8_stats;
+
+/**
+ * Define run time statistics for ISR 9.
+ */
+volatile struct hsk_isr9_stats xdata hsk_isr9_stats;
+
+volatile ulong xdata hsk_isr_idleCount;
+
+void hsk_isr_idle(void) {
+	hsk_isr_idleCount++;
+}
+
+void hsk_isr_stats_clear(void) {
+	bool ea = EA;
+	EA = 0;
+	memset(&hsk_isr5_stats, 0, sizeof(hsk_isr5_stats));
+	memset(&hsk_isr6_stats, 0, sizeof(hsk_isr6_stats));
+	memset(&hsk_isr8_stats, 0, sizeof(hsk_isr8_stats));
+	memset(&hsk_isr9_stats, 0, sizeof(hsk_isr9_stats));
+	hsk_isr_idleCount = 0;
+	EA = ea;
+}
+
+/**
+ * Samples the CCT.
+ *
+ * This uses SST1/RST1, so it must not be used within callbacks.
+ *
+ * @param time
+ *	The uword to store the CCT value in
+ * @private
+ */
+#define STATS_TIME(time) { \
+	SFR_PAGE(_t2_1, SST1); \
+	time = T2CCU_CCTLH; \
+	SFR_PAGE(_t2_1, RST1); \
+}
+
+/**
+ * Updates run time statistics.
+ *
+ * @param stat
+ *	The hsk_isr_stat to update
+ * @param start
+ *	The CCT value at the start of the measurement
+ * @private
+ */
+#define STATS_UPDATE(stat, start) { \
+	uword time; \
+	STATS_TIME(time); \
+	time -= start; \
+	if (time > stat.max) { \
+		stat.max = time; \
+	} \
+	/* Stop accumulating together, to keep sum / count valid. */ \
+	if (stat.sum <= 0xfffffffful - time) { \
+		stat.count++; \
+		stat.sum += time; \
+	} \
+}
+
+/**
+ * Declares the variables used for collecting statistics within an ISR.
+ *
+ * @private
+ */
+#define STATS_VARS    uword statsEntry, statsStart;
+
+/**
+ * Records the start of an ISR.
+ *
+ * @private
+ */
+#define STATS_ENTER()    STATS_TIME(statsEntry)
+
+/**
+ * Records the end of an ISR.
+ *
+ * @param isr
+ *	The number of the ISR
+ * @private
+ */
+#define STATS_EXIT(isr)  STATS_UPDATE(hsk_isr##isr##_stats.ISR, statsEntry)
+
+/**
+ * Calls a callback function and records its run time.
+ *
+ * @param isr
+ *	The number of the ISR
+ * @param source
+ *	The interrupt source
+ * @private
+ */
+#define CALL(isr, source) { \
+	STATS_TIME(statsStart); \
+	hsk_isr##isr.source(); \
+	STATS_UPDATE(hsk_isr##isr##_stats.source, statsStart); \
+}
+
+/**
+ * Calls a callback function with an argument and records its run time.
+ *
+ * @param isr
+ *	The number of the ISR
+ * @param source
+ *	The interrupt source
+ * @param arg
+ *	The argument to pass to the callback
+ * @private
+ */
+#define CALL_ARG(isr, source, arg) { \
+	STATS_TIME(statsStart); \
+	hsk_isr##isr.source(arg); \
+	STATS_UPDATE(hsk_isr##isr##_stats.source, statsStart); \
+}
+
+#else /* HSK_ISR_STATS */
+
+/**
+ * Declares the variables used for collecting statistics within an ISR.
+ *
+ * @private
+ */
+#define STATS_VARS
+
+/**
+ * Records the start of an ISR.
+ *
+ * @private
+ */
+#define STATS_ENTER()
+
+/**
+ * Records the end of an ISR.
+ *
+ * @param isr
+ *	The number of the ISR
+ * @private
+ */
+#define STATS_EXIT(isr)
+
+/**
+ * Calls a callback function.
+ *
+ * @param isr
+ *	The number of the ISR
+ * @param source
+ *	The interrupt source
+ * @private
+ */
+#define CALL(isr, source)    hsk_isr##isr.source()
+
+/**
+ * Calls a callback function with an argument.
+ *
+ * @param isr
+ *	The number of the ISR
+ * @param source
+ *	The interrupt source
+ * @param arg
+ *	The argument to pass to the callback
+ * @private
+ */
+#define CALL_ARG(isr, source, arg)    hsk_isr##isr.source(arg)
+
+#endif /* HSK_ISR_STATS */
+
 /**
  * This is a dummy function used for putting register bank 1 using ISRs
  * into a common call tree for C51.
@@ -42,6 +296,16 @@ void dummy(void) using 1 {
 }
 
 
+/**
+ * This is a dummy function to point unused event callback pointers to.
+ *
+ * @param events
+ *	The ignored events
+ * @private
+ */
+void eventsdummy(const ubyte events) using 1 {
+}
+
 /**
  * This is a dummy function to point unused function pointers to.
  *
@@ -113,45 +377,64 @@ volatile struct hsk_isr5_callback pdata hsk_isr5 = {&dummy, &dummy, &dummy, &dum
  */
 void ISR_hsk_isr5(void) interrupt 5 using 1 {
 	bool rmap = (SYSCON0 >> BIT_RMAP) & 1;
+	STATS_VARS
 	RESET_RMAP();
+	STATS_ENTER();
 
+#if defined HSK_ISR5_TF2 || defined HSK_ISR5_EXF2 || defined HSK_ISR5_CCTOVF
 	SFR_PAGE(_t2_0, SST0);
+#ifdef HSK_ISR5_TF2
 	if (T2_T2CON & (1 << BIT_TF2)) {
 		T2_T2CON &= ~(1 << BIT_TF2);
-		hsk_isr5.TF2();
+		CALL(5, TF2);
 	}
+#endif
+#ifdef HSK_ISR5_EXF2
 	if (T2_T2CON & (1 << BIT_EXF2)) {
 		T2_T2CON &= ~(1 << BIT_EXF2);
-		hsk_isr5.EXF2();
+		CALL(5, EXF2);
 	}
-	SFR_PAGE(_t2_0, RST0);
-
-	SFR_PAGE(_t2_1, SST0);
+#endif
+#ifdef HSK_ISR5_CCTOVF
+	SFR_PAGE(_t2_1, noSST);
 	if (T2CCU_CCTCON & (1 << BIT_CCTOVF)) {
 		T2CCU_CCTCON &= ~(1 << BIT_CCTOVF);
-		hsk_isr5.CCTOVF();
+		CALL(5, CCTOVF);
 	}
-	SFR_PAGE(_t2_2, RST0);
+#endif
+	SFR_PAGE(_t2_0, RST0);
+#endif
 
+#if defined HSK_ISR5_NDOV || defined HSK_ISR5_EOFSYN || defined HSK_ISR5_ERRSYN || defined HSK_ISR5_CANSRC0
 	SFR_PAGE(_su0, SST0);
+#ifdef HSK_ISR5_NDOV
 	if (FDCON & (1 << BIT_NDOV)) {
 		FDCON &= ~(1 << BIT_NDOV);
-		hsk_isr5.NDOV();
+		CALL(5, NDOV);
 	}
+#endif
+#ifdef HSK_ISR5_EOFSYN
 	if (FDCON & (1 << BIT_EOFSYN)) {
 		FDCON &= ~(1 << BIT_EOFSYN);
-		hsk_isr5.EOFSYN();
+		CALL(5, EOFSYN);
 	}
+#endif
+#ifdef HSK_ISR5_ERRSYN
 	if (FDCON & (1 << BIT_ERRSYN)) {
 		FDCON &= ~(1 << BIT_ERRSYN);
-		hsk_isr5.ERRSYN();
+		CALL(5, ERRSYN);
 	}
+#endif
+#ifdef HSK_ISR5_CANSRC0
 	if (IRCON2 & (1 << BIT_CANSRC0)) {
 		FDCON &= ~(1 << BIT_CANSRC0);
-		hsk_isr5.CANSRC0();
+		CALL(5, CANSRC0);
 	}
+#endif
 	SFR_PAGE(_su0, RST0);
+#endif
 
+	STATS_EXIT(5);
 	rmap ? (SET_RMAP()) : (RESET_RMAP());
 }
 
@@ -180,6 +463,36 @@ volatile struct hsk_isr6_callback pdata hsk_isr6 = {&dummy, &dummy, &dummy, &dum
  */
 #define BIT_ADCSR1      4
 
+#ifdef HSK_ISR6_CANSRC1
+#define ISR6_CANSRC1_UNHANDLED    0
+#else
+#define ISR6_CANSRC1_UNHANDLED    (1 << BIT_CANSRC1)
+#endif
+
+#ifdef HSK_ISR6_CANSRC2
+#define ISR6_CANSRC2_UNHANDLED    0
+#else
+#define ISR6_CANSRC2_UNHANDLED    (1 << BIT_CANSRC2)
+#endif
+
+#ifdef HSK_ISR6_ADCSR0
+#define ISR6_ADCSR0_UNHANDLED    0
+#else
+#define ISR6_ADCSR0_UNHANDLED    (1 << BIT_ADCSR0)
+#endif
+
+#ifdef HSK_ISR6_ADCSR1
+#define ISR6_ADCSR1_UNHANDLED    0
+#else
+#define ISR6_ADCSR1_UNHANDLED    (1 << BIT_ADCSR1)
+#endif
+
+/**
+ * The IRCON1 events without a registered source.
+ */
+#define ISR6_UNHANDLED    (ISR6_CANSRC1_UNHANDLED | ISR6_CANSRC2_UNHANDLED \
+                           | ISR6_ADCSR0_UNHANDLED | ISR6_ADCSR1_UNHANDLED)
+
 /**
  * Shared interrupt 6 routine.
  *
@@ -195,27 +508,40 @@ volatile struct hsk_isr6_callback pdata hsk_isr6 = {&dummy, &dummy, &dummy, &dum
  */
 void ISR_hsk_isr6(void) interrupt 6 using 1 {
 	bool rmap = (SYSCON0 >> BIT_RMAP) & 1;
+	STATS_VARS
 	RESET_RMAP();
+	STATS_ENTER();
 
 	SFR_PAGE(_su0, SST0);
+	/* Acknowledge events without a handler. */
+	IRCON1 &= ~ISR6_UNHANDLED;
+#ifdef HSK_ISR6_ADCSR0
+	if (IRCON1 & (1 << BIT_ADCSR0)) {
+		IRCON1 &= ~(1 << BIT_ADCSR0);
+		CALL(6, ADCSR0);
+	}
+#endif
+#ifdef HSK_ISR6_CANSRC1
 	if (IRCON1 & (1 << BIT_CANSRC1)) {
 		IRCON1 &= ~(1 << BIT_CANSRC1);
-		hsk_isr6.CANSRC1();
+		CALL(6, CANSRC1);
 	}
+#endif
+#ifdef HSK_ISR6_CANSRC2
 	if (IRCON1 & (1 << BIT_CANSRC2)) {
 		IRCON1 &= ~(1 << BIT_CANSRC2);
-		hsk_isr6.CANSRC2();
-	}
-	if (IRCON1 & (1 << BIT_ADCSR0)) {
-		IRCON1 &= ~(1 << BIT_ADCSR0);
-		hsk_isr6.ADCSR0();
+		CALL(6, CANSRC2);
 	}
+#endif
+#ifdef HSK_ISR6_ADCSR1
 	if (IRCON1 & (1 << BIT_ADCSR1)) {
 		IRCON1 &= ~(1 << BIT_ADCSR1);
-		hsk_isr6.ADCSR1();
+		CALL(6, ADCSR1);
 	}
+#endif
 	SFR_PAGE(_su0, RST0);
 
+	STATS_EXIT(6);
 	rmap ? (SET_RMAP()) : (RESET_RMAP());
 }
 
@@ -290,56 +616,81 @@ volatile struct hsk_isr8_callback pdata hsk_isr8 = {&dummy, &dummy, &dummy, &dum
  */
 void ISR_hsk_isr8(void) interrupt 8 using 1 {
 	bool rmap = (SYSCON0 >> BIT_RMAP) & 1;
+	STATS_VARS
 	RESET_RMAP();
+	STATS_ENTER();
 
+#if defined HSK_ISR8_EXINT2 || defined HSK_ISR8_NDOV
 	SFR_PAGE(_su0, SST0);
+#ifdef HSK_ISR8_EXINT2
 	if (IRCON0 & (1 << BIT_EXINT2)) {
-		hsk_isr8.EXINT2();
+		CALL(8, EXINT2);
 	}
+#endif
+#ifdef HSK_ISR8_NDOV
 	if (FDCON & (1 << BIT_NDOV)) {
-		hsk_isr8.NDOV();
+		CALL(8, NDOV);
 	}
+#endif
 	SFR_PAGE(_su0, RST0);
+#endif
 
+#ifdef HSK_ISR8_RI
 	if (SCON & (1 << BIT_RI)) {
-		hsk_isr8.RI();
+		CALL(8, RI);
 	}
+#endif
+#ifdef HSK_ISR8_TI
 	if (SCON & (1 << BIT_TI)) {
-		hsk_isr8.TI();
+		CALL(8, TI);
 	}
+#endif
 
+#if defined HSK_ISR8_TF2 || defined HSK_ISR8_EXF2
 	SFR_PAGE(_t2_0, SST0);
+#ifdef HSK_ISR8_TF2
 	if (T2_T2CON & (1 << BIT_TF2)) {
-		hsk_isr8.TF2();
+		CALL(8, TF2);
 	}
+#endif
+#ifdef HSK_ISR8_EXF2
 	if (T2_T2CON & (1 << BIT_EXF2)) {
-		hsk_isr8.EXF2();
+		CALL(8, EXF2);
 	}
+#endif
 	SFR_PAGE(_t2_0, RST0);
+#endif
 
+#ifdef HSK_ISR8_EOC
 	SET_RMAP();
 	if (CD_STATC & (1 << BIT_EOC)) {
 		RESET_RMAP();
-		hsk_isr8.EOC();
+		CALL(8, EOC);
 	}
+#endif
+#ifdef HSK_ISR8_IRDY
 	SET_RMAP();
 	if (MDU_MDUSTAT & (1 << BIT_IRDY)) {
 		RESET_RMAP();
-		hsk_isr8.IRDY();
+		CALL(8, IRDY);
 	}
+#endif
+#ifdef HSK_ISR8_IERR
 	SET_RMAP();
 	if (MDU_MDUSTAT & (1 << BIT_IERR)) {
 		RESET_RMAP();
-		hsk_isr8.IERR();
+		CALL(8, IERR);
 	}
+#endif
 
+	STATS_EXIT(8);
 	rmap ? (SET_RMAP()) : (RESET_RMAP());
 }
 
 /**
  * Define callback function pointers for ISR 9.
  */
-volatile struct hsk_isr9_callback pdata hsk_isr9 = {&dummy, &dummy, &dummy, &dummy, &dummy};
+volatile struct hsk_isr9_callback pdata hsk_isr9 = {&dummy, &dummy, &dummy, &dummy, &dummy, &eventsdummy, 0};
 
 /**
  * IRCON0 Interrupt Flag for External Interrupt 3 or T2CC0 Capture/Compare
@@ -370,6 +721,38 @@ volatile struct hsk_isr9_callback pdata hsk_isr9 = {&dummy, &dummy, &dummy, &dum
  */
 #define BIT_CANSRC3     4
 
+#ifdef HSK_ISR9_EXINT3
+#define ISR9_EXINT3_UNHANDLED    0
+#else
+#define ISR9_EXINT3_UNHANDLED    (1 << BIT_EXINT3)
+#endif
+
+#ifdef HSK_ISR9_EXINT4
+#define ISR9_EXINT4_UNHANDLED    0
+#else
+#define ISR9_EXINT4_UNHANDLED    (1 << BIT_EXINT4)
+#endif
+
+#ifdef HSK_ISR9_EXINT5
+#define ISR9_EXINT5_UNHANDLED    0
+#else
+#define ISR9_EXINT5_UNHANDLED    (1 << BIT_EXINT5)
+#endif
+
+#ifdef HSK_ISR9_EXINT6
+#define ISR9_EXINT6_UNHANDLED    0
+#else
+#define ISR9_EXINT6_UNHANDLED    (1 << BIT_EXINT6)
+#endif
+
+/**
+ * The IRCON0 events without a registered source.
+ *
+ * Events selected by hsk_isr9.T2CCmask are handled by T2CC.
+ */
+#define ISR9_UNHANDLED    (ISR9_EXINT3_UNHANDLED | ISR9_EXINT4_UNHANDLED \
+                           | ISR9_EXINT5_UNHANDLED | ISR9_EXINT6_UNHANDLED)
+
 /**
  * Shared interrupt 9 routine.
  *
@@ -386,31 +769,60 @@ volatile struct hsk_isr9_callback pdata hsk_isr9 = {&dummy, &dummy, &dummy, &dum
  */
 void ISR_hsk_isr9(void) interrupt 9 using 1 {
 	bool rmap = (SYSCON0 >> BIT_RMAP) & 1;
+#ifdef HSK_ISR9_T2CC
+	ubyte events;
+#endif
+	STATS_VARS
 	RESET_RMAP();
+	STATS_ENTER();
 
 	SFR_PAGE(_su0, SST0);
+#ifdef HSK_ISR9_T2CC
+	/* Batch process capture events. */
+	events = (IRCON0 >> BIT_EXINT3) & hsk_isr9.T2CCmask;
+	if (events) {
+		IRCON0 &= ~(events << BIT_EXINT3);
+		CALL_ARG(9, T2CC, events);
+	}
+	/* Acknowledge events without a handler. */
+	IRCON0 &= ~ISR9_UNHANDLED | (hsk_isr9.T2CCmask << BIT_EXINT3);
+#else
+	/* Acknowledge events without a handler. */
+	IRCON0 &= ~ISR9_UNHANDLED;
+#endif
+#ifdef HSK_ISR9_EXINT3
 	if (IRCON0 & (1 << BIT_EXINT3)) {
 		IRCON0 &= ~(1 << BIT_EXINT3);
-		hsk_isr9.EXINT3();
+		CALL(9, EXINT3);
 	}
+#endif
+#ifdef HSK_ISR9_EXINT4
 	if (IRCON0 & (1 << BIT_EXINT4)) {
 		IRCON0 &= ~(1 << BIT_EXINT4);
-		hsk_isr9.EXINT4();
+		CALL(9, EXINT4);
 	}
+#endif
+#ifdef HSK_ISR9_EXINT5
 	if (IRCON0 & (1 << BIT_EXINT5)) {
 		IRCON0 &= ~(1 << BIT_EXINT5);
-		hsk_isr9.EXINT5();
+		CALL(9, EXINT5);
 	}
+#endif
+#ifdef HSK_ISR9_EXINT6
 	if (IRCON0 & (1 << BIT_EXINT6)) {
 		IRCON0 &= ~(1 << BIT_EXINT6);
-		hsk_isr9.EXINT6();
+		CALL(9, EXINT6);
 	}
+#endif
+#ifdef HSK_ISR9_CANSRC3
 	if (IRCON2 & (1 << BIT_CANSRC3)) {
 		IRCON1 &= ~(1 << BIT_CANSRC3);
-		hsk_isr9.CANSRC3();
+		CALL(9, CANSRC3);
 	}
+#endif
 	SFR_PAGE(_su0, RST0);
 
+	STATS_EXIT(9);
 	rmap ? (SET_RMAP()) : (RESET_RMAP());
 }
 
@@ -53,6 +53,14 @@
  *
  * Assigning higher priority to an ISR will affect (as in break) the operation
  * of all lower priority ISRs.
+ *
+ * \section isr_stats Run Time Statistics
+ *
+ * If the library is built with HSK_ISR_STATS defined, the shared ISRs 5, 6,
+ * 8 and 9 record the number of calls and the run times of every callback
+ * and of the ISRs themselves. See hsk_isr_stat.
+ *
+ * The CCT is sampled using SST1/RST1 outside of the callbacks.
  */
 
 #ifndef _HSK_ISR_H_
@@ -266,6 +274,9 @@ extern volatile struct hsk_isr8_callback pdata hsk_isr8;
  * - EXINT5/T2CC2
  * - EXINT6/T2CC3
  * - CANSRC2
+ *
+ * The EXINT3-6/T2CC0-3 events selected in T2CCmask are handled with a
+ * single call of T2CC instead of the individual callbacks.
  */
 struct hsk_isr9_callback {
 	/**
@@ -297,6 +308,21 @@ struct hsk_isr9_callback {
 	 * triggered.
 	 */
 	void (code *CANSRC3)(void) using(1);
+
+	/**
+	 * Function to be called back once for all pending EXINT3-6/T2CC0-3
+	 * events selected in T2CCmask.
+	 *
+	 * The events are passed as a bit field, bit 0 represents
+	 * EXINT3/T2CC0, bit 3 EXINT6/T2CC3.
+	 */
+	void (code *T2CC)(const ubyte events) using(1);
+
+	/**
+	 * Selects the EXINT3-6/T2CC0-3 events handled by T2CC, the bits
+	 * are arranged like the events passed to T2CC.
+	 */
+	ubyte T2CCmask;
 };
 
 /**
@@ -354,6 +380,247 @@ struct hsk_isr14_callback {
  */
 extern volatile struct hsk_isr14_callback pdata hsk_isr14;
 
+#ifdef HSK_ISR_STATS
+
+/**
+ * Run time statistics of a shared ISR or callback.
+ *
+ * Run times are measured in ticks of the T2CCU Capture/Compare Timer (CCT),
+ * so they are only valid while the CCT is running, e.g. after calling
+ * hsk_pwc_init(). Statistics are updated in ISR context, so interrupts
+ * should be disabled while reading them.
+ *
+ * The count and the sum stop accumulating together once the sum would
+ * overflow, so sum / count always yields the average run time.
+ */
+typedef struct {
+	/**
+	 * The number of calls.
+	 */
+	ulong count;
+
+	/**
+	 * The longest run time.
+	 */
+	uword max;
+
+	/**
+	 * The accumulated run time.
+	 */
+	ulong sum;
+} hsk_isr_stat;
+
+/**
+ * Run time statistics for ISR 5 and its callbacks.
+ */
+struct hsk_isr5_stats {
+	/**
+	 * Statistics for the complete ISR.
+	 */
+	hsk_isr_stat ISR;
+
+	/**
+	 * Statistics for the TF2 callback.
+	 */
+	hsk_isr_stat TF2;
+
+	/**
+	 * Statistics for the EXF2 callback.
+	 */
+	hsk_isr_stat EXF2;
+
+	/**
+	 * Statistics for the CCTOVF callback.
+	 */
+	hsk_isr_stat CCTOVF;
+
+	/**
+	 * Statistics for the NDOV callback.
+	 */
+	hsk_isr_stat NDOV;
+
+	/**
+	 * Statistics for the EOFSYN callback.
+	 */
+	hsk_isr_stat EOFSYN;
+
+	/**
+	 * Statistics for the ERRSYN callback.
+	 */
+	hsk_isr_stat ERRSYN;
+
+	/**
+	 * Statistics for the CANSRC0 callback.
+	 */
+	hsk_isr_stat CANSRC0;
+};
+
+/**
+ * Introduce run time statistics for ISR 5.
+ */
+extern volatile struct hsk_isr5_stats xdata hsk_isr5_stats;
+
+/**
+ * Run time statistics for ISR 6 and its callbacks.
+ */
+struct hsk_isr6_stats {
+	/**
+	 * Statistics for the complete ISR.
+	 */
+	hsk_isr_stat ISR;
+
+	/**
+	 * Statistics for the CANSRC1 callback.
+	 */
+	hsk_isr_stat CANSRC1;
+
+	/**
+	 * Statistics for the CANSRC2 callback.
+	 */
+	hsk_isr_stat CANSRC2;
+
+	/**
+	 * Statistics for the ADCSR0 callback.
+	 */
+	hsk_isr_stat ADCSR0;
+
+	/**
+	 * Statistics for the ADCSR1 callback.
+	 */
+	hsk_isr_stat ADCSR1;
+};
+
+/**
+ * Introduce run time statistics for ISR 6.
+ */
+extern volatile struct hsk_isr6_stats xdata hsk_isr6_stats;
+
+/**
+ * Run time statistics for ISR 8 and its callbacks.
+ */
+struct hsk_isr8_stats {
+	/**
+	 * Statistics for the complete ISR.
+	 */
+	hsk_isr_stat ISR;
+
+	/**
+	 * Statistics for the EXINT2 callback.
+	 */
+	hsk_isr_stat EXINT2;
+
+	/**
+	 * Statistics for the RI callback.
+	 */
+	hsk_isr_stat RI;
+
+	/**
+	 * Statistics for the TI callback.
+	 */
+	hsk_isr_stat TI;
+
+	/**
+	 * Statistics for the TF2 callback.
+	 */
+	hsk_isr_stat TF2;
+
+	/**
+	 * Statistics for the EXF2 callback.
+	 */
+	hsk_isr_stat EXF2;
+
+	/**
+	 * Statistics for the NDOV callback.
+	 */
+	hsk_isr_stat NDOV;
+
+	/**
+	 * Statistics for the EOC callback.
+	 */
+	hsk_isr_stat EOC;
+
+	/**
+	 * Statistics for the IRDY callback.
+	 */
+	hsk_isr_stat IRDY;
+
+	/**
+	 * Statistics for the IERR callback.
+	 */
+	hsk_isr_stat IERR;
+};
+
+/**
+ * Introduce run time statistics for ISR 8.
+ */
+extern volatile struct hsk_isr8_stats xdata hsk_isr8_stats;
+
+/**
+ * Run time statistics for ISR 9 and its callbacks.
+ */
+struct hsk_isr9_stats {
+	/**
+	 * Statistics for the complete ISR.
+	 */
+	hsk_isr_stat ISR;
+
+	/**
+	 * Statistics for the EXINT3 callback.
+	 */
+	hsk_isr_stat EXINT3;
+
+	/**
+	 * Statistics for the EXINT4 callback.
+	 */
+	hsk_isr_stat EXINT4;
+
+	/**
+	 * Statistics for the EXINT5 callback.
+	 */
+	hsk_isr_stat EXINT5;
+
+	/**
+	 * Statistics for the EXINT6 callback.
+	 */
+	hsk_isr_stat EXINT6;
+
+	/**
+	 * Statistics for the CANSRC3 callback.
+	 */
+	hsk_isr_stat CANSRC3;
+
+	/**
+	 * Statistics for the T2CC callback.
+	 */
+	hsk_isr_stat T2CC;
+};
+
+/**
+ * Introduce run time statistics for ISR 9.
+ */
+extern volatile struct hsk_isr9_stats xdata hsk_isr9_stats;
+
+/**
+ * The main loop idle counter.
+ *
+ * Compare the increments per time with those of an unloaded system
+ * to get the CPU load.
+ */
+extern volatile ulong xdata hsk_isr_idleCount;
+
+/**
+ * Increments the idle counter, call this from the idle part of the
+ * main loop.
+ */
+void hsk_isr_idle(void);
+
+/**
+ * Resets all ISR run time statistics and the idle counter.
+ */
+void hsk_isr_stats_clear(void);
+
+#endif /* HSK_ISR_STATS */
+
 /*
  * Restore the usual meaning of \c code.
  */
@@ -0,0 +1,123 @@
+/** \file
+ * HSK Block Pool implementation
+ *
+ * Every free block starts with a pointer to the next free block, the last
+ * free block points to 0. The XRAM is not mapped to address 0, so 0 is
+ * never a valid block address.
+ *
+ * The list manipulation is implemented as macros, because it is used in
+ * ISR callbacks and in regular code, which use different register banks.
+ * Interrupts are suspended during list manipulation, so pools can be
+ * shared between ISRs of different priorities and regular code.
+ *
+ * @author kami
+ */
+
+#include <Infineon/XC878.h>
+
+#include "hsk_pool.h"
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/**
+ * Accesses the next pointer of a free block.
+ *
+ * @param block
+ *	The free block
+ */
+#define POOL_NEXT(block)    (*(ubyte xdata * xdata *)(block))
+
+/**
+ * Takes the first block from the free list.
+ *
+ * @param pool
+ *	The pool to allocate from
+ * @param block
+ *	The variable to store the block in
+ * @private
+ */
+#define POOL_ALLOC(pool, block) { \
+	bool ea = EA; \
+	EA = 0; \
+	block = pool->free; \
+	if (block) { \
+		pool->free = POOL_NEXT(block); \
+		if (++pool->used > pool->peak) { \
+			pool->peak = pool->used; \
+		} \
+	} else if (pool->fails < 0xff) { \
+		pool->fails++; \
+	} \
+	EA = ea; \
+}
+
+/**
+ * Puts a block in front of the free list.
+ *
+ * @param pool
+ *	The pool the block belongs to
+ * @param block
+ *	The block to return
+ * @private
+ */
+#define POOL_FREE(pool, block) { \
+	bool ea = EA; \
+	EA = 0; \
+	POOL_NEXT(block) = pool->free; \
+	pool->free = block; \
+	pool->used--; \
+	EA = ea; \
+}
+
+void hsk_pool_init(hsk_pool xdata * const pool, void xdata * const blocks,
+                   const uword length, const ubyte size) {
+	ubyte xdata * block = blocks;
+	ubyte count = length / size > 0xff ? 0xff : length / size;
+	ubyte i;
+
+	/* Link all blocks, the last one ends the list. */
+	for (i = 1; i < count; i++) {
+		POOL_NEXT(block) = block + size;
+		block += size;
+	}
+	if (count) {
+		POOL_NEXT(block) = 0;
+	}
+
+	pool->free = count ? blocks : 0;
+	pool->used = 0;
+	pool->peak = 0;
+	pool->fails = 0;
+	pool->count = count;
+}
+
+void xdata * hsk_pool_alloc(hsk_pool xdata * const pool) {
+	ubyte xdata * block;
+	POOL_ALLOC(pool, block);
+	return block;
+}
+
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+void xdata * hsk_pool_isr_alloc(hsk_pool xdata * const pool) using 1 {
+	ubyte xdata * block;
+	POOL_ALLOC(pool, block);
+	return block;
+}
+
+void hsk_pool_isr_free(hsk_pool xdata * const pool,
+                       void xdata * const block) using 1 {
+	POOL_FREE(pool, block);
+}
+#pragma restore
+
+void hsk_pool_free(hsk_pool xdata * const pool, void xdata * const block) {
+	POOL_FREE(pool, block);
+}
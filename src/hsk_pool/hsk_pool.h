@@ -0,0 +1,182 @@
+/** \file
+ * HSK Block Pool headers
+ *
+ * Provides pools of fixed size xdata memory blocks.
+ *
+ * Allocating and freeing a block takes constant time and a pool cannot
+ * fragment. The free blocks of a pool are kept in a list, which is stored
+ * in the free blocks themselves, so a pool has no memory overhead apart
+ * from its descriptor.
+ *
+ * A pool is created with the \ref POOL_FACTORY macro:
+ * \code
+ * POOL_FACTORY(msgPool, 16, 8);
+ * \endcode
+ *
+ * Pools can be used from ISR callbacks with hsk_pool_isr_alloc() and
+ * hsk_pool_isr_free(). E.g. the CAN receive ring buffer allocates its
+ * frames from \c hsk_can_rx_pool in the CANSRC1 ISR, and SSC buffers can
+ * be allocated for hsk_ssc_queue() and returned to the pool by the SSC
+ * callback.
+ *
+ * Pools that are used in mutually exclusive phases, e.g. boot and run
+ * time, can share their storage. Once all blocks of the first pool are
+ * free, its storage can be handed to the next pool:
+ * \code
+ * hsk_pool_init(&runPool, bootPool_blocks, sizeof(bootPool_blocks), 32);
+ * \endcode
+ *
+ * @author kami
+ */
+
+#ifndef _HSK_POOL_H_
+#define _HSK_POOL_H_
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/**
+ * A pool descriptor.
+ *
+ * The members \c used, \c peak and \c fails provide a usage report, they
+ * must not be changed.
+ */
+typedef struct {
+	/**
+	 * The first free block.
+	 *
+	 * @private
+	 */
+	ubyte xdata * free;
+
+	/**
+	 * The number of allocated blocks.
+	 */
+	ubyte used;
+
+	/**
+	 * The highest number of blocks allocated at the same time.
+	 */
+	ubyte peak;
+
+	/**
+	 * The number of failed allocations, saturates at 255.
+	 */
+	ubyte fails;
+
+	/**
+	 * The number of blocks in the pool.
+	 */
+	ubyte count;
+} hsk_pool;
+
+/**
+ * Creates a block pool.
+ *
+ * The storage of the pool is named \<prefix\>_blocks and the pool is set
+ * up by calling \<prefix\>_init().
+ *
+ * @param prefix
+ *	The name of the pool descriptor
+ * @param size
+ *	The size of a block, at least 2 bytes
+ * @param count
+ *	The number of blocks, up to 255
+ */
+#define POOL_FACTORY(prefix, size, count) \
+	\
+	/**
+	 * The storage of the pool.
+	 *
+	 * @see POOL_FACTORY
+	 */\
+	ubyte xdata prefix##_blocks[(size) * (count)]; \
+	\
+	/**
+	 * The pool descriptor.
+	 *
+	 * @see POOL_FACTORY
+	 */\
+	hsk_pool xdata prefix; \
+	\
+	/**
+	 * Sets up the pool, all blocks are free afterwards.
+	 *
+	 * @see POOL_FACTORY
+	 */\
+	void prefix##_init(void) { \
+		hsk_pool_init(&prefix, prefix##_blocks, \
+		              sizeof(prefix##_blocks), size); \
+	}
+
+/**
+ * Sets up a pool, all blocks are free afterwards.
+ *
+ * This can also be used to hand the storage of a pool that is no longer
+ * used to a different pool.
+ *
+ * @param pool
+ *	The pool descriptor
+ * @param blocks
+ *	The storage to divide into blocks
+ * @param length
+ *	The size of the storage in bytes
+ * @param size
+ *	The size of a block, at least 2 bytes
+ */
+void hsk_pool_init(hsk_pool xdata * const pool, void xdata * const blocks,
+                   const uword length, const ubyte size);
+
+/**
+ * Allocates a block.
+ *
+ * @param pool
+ *	The pool to allocate from
+ * @return
+ *	A pointer to the block or 0 if the pool is exhausted
+ */
+void xdata * hsk_pool_alloc(hsk_pool xdata * const pool);
+
+/**
+ * Allocates a block from within an ISR callback.
+ *
+ * @param pool
+ *	The pool to allocate from
+ * @return
+ *	A pointer to the block or 0 if the pool is exhausted
+ */
+void xdata * hsk_pool_isr_alloc(hsk_pool xdata * const pool) using(1);
+
+/**
+ * Returns a block to its pool.
+ *
+ * @param pool
+ *	The pool the block was allocated from
+ * @param block
+ *	The block to return
+ */
+void hsk_pool_free(hsk_pool xdata * const pool, void xdata * const block);
+
+/**
+ * Returns a block to its pool from within an ISR callback.
+ *
+ * @param pool
+ *	The pool the block was allocated from
+ * @param block
+ *	The block to return
+ */
+void hsk_pool_isr_free(hsk_pool xdata * const pool,
+                       void xdata * const block) using(1);
+
+/*
+ * Restore the usual meaning of \c using(bank).
+ */
+#ifdef __C51__
+	#undef using
+#endif /* __C51__ */
+
+#endif /* _HSK_POOL_H_ */
@@ -15,11 +15,6 @@
 
 #include "../hsk_isr/hsk_isr.h"
 
-/**
- * The number of available PWC channels.
- */
-#define PWC_CHANNELS         4
-
 /**
  * The size of a PWC ring buffer.
  *
@@ -41,6 +36,69 @@ static ubyte xdata prescaler;
  */
 static volatile ubyte pdata overflows;
 
+/**
+ * A bit mask of open channels.
+ */
+static ubyte xdata opened;
+
+/**
+ * The number of time units, i.e. raw, ns, µs and ms.
+ */
+#define PWC_TIME_UNITS       4
+
+/**
+ * A fixed point conversion factor.
+ *
+ * A value x is converted by calculating \f$(x \cdot mul) >> shift\f$.
+ */
+typedef struct {
+	/**
+	 * The multiplicator, in the range \f$[2^{11}; 2^{12})\f$ unless the
+	 * factor is greater.
+	 */
+	ulong mul;
+
+	/**
+	 * The number of fraction bits in mul.
+	 */
+	ubyte shift;
+} hsk_pwc_factor;
+
+/** \var factors
+ * Unit conversion factors.
+ *
+ * The factors are calculated once, when the prescaler or the number of
+ * averaged values change, so getting most values does not require a
+ * division.
+ *
+ * The multiplicators are limited to 12 bits, so that multiplying them
+ * with a sum of up to 8 CCT values cannot overflow.
+ */
+static struct {
+	/**
+	 * Conversion factors for CCT value sums into average pulse widths.
+	 *
+	 * Raw widths are divided exactly instead, so the first entry is
+	 * the ns factor.
+	 */
+	hsk_pwc_factor widths[PWC_CHANNELS][PWC_TIME_UNITS - 1];
+
+	/**
+	 * Conversion factors for single CCT values into pulse widths.
+	 */
+	hsk_pwc_factor duty[PWC_TIME_UNITS];
+
+	/**
+	 * The dividends for frequencies in 1/s.
+	 */
+	ulong freqS[PWC_CHANNELS];
+
+	/**
+	 * The dividend for frequencies in 1/m.
+	 */
+	ulong freqM;
+} xdata factors;
+
 /** \var channels
  * Processing data for PWC channels.
  */
@@ -94,210 +152,179 @@ static volatile struct {
 	 * a low pulse.
 	 */
 	ubyte state;
+
+	/**
+	 * The update sequence counter.
+	 *
+	 * This is incremented by every update, a snapshot is consistent
+	 * if it did not change while copying the channel data.
+	 */
+	ubyte seq;
 } pdata channels[PWC_CHANNELS];
 
-#pragma save
-#ifdef SDCC
-#pragma nooverlay
-#endif
-/**
- * This is the common implementation of the Capture ISRs.
- *
- * @param channel
- *	The channel that was captured.
- * @param capture
- *	The value that was captured.
- * @private
- */
-void hsk_pwc_isr_ccn(const hsk_pwc_channel channel, uword capture) using 1 {
-	#define channel    channels[channel]
-	/* Get the new value and store the current capture value for next
-	 * time. */
-	capture -= channel.lastCapture;
-	channel.lastCapture += capture;
-	/* Update the sum and buffer. */
-	channel.sum -= channel.buffer[channel.pos];
-	channel.buffer[channel.pos++] = capture;
-	channel.pos %= channel.averageOver;
-	channel.sum += capture;
-	/* Update the overflow count.. */
-	channel.overflow = overflows;
-	/* Update the invalidation count. */
-	if (channel.invalid) {
-		channel.invalid--;
-	}
-	#undef channel
-}
+#ifdef HSK_PWC_RAW
 
-/**
- * The ISR for Capture events on channel PWC_CC0_P30.
+/** \var raws
+ * Raw capture ring buffers for PWC channels.
  *
- * @private
+ * There is a single producer (the capture) and a single consumer
+ * (hsk_pwc_channel_rawRead()), so no locking is required for the ring.
+ * Only the lost counter is modified by both.
  */
-void hsk_pwc_isr_cc0_p30(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[0].state = (P3_DATA >> 0) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(0, T2CCU_CC0LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+static volatile struct {
+	/**
+	 * The ring buffer of captured timer values.
+	 */
+	uword buffer[PWC_RAW_SIZE];
 
-/**
- * The ISR for Capture events on channel PWC_CC0_P40.
- *
- * @private
- */
-void hsk_pwc_isr_cc0_p40(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[0].state = (P4_DATA >> 0) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(0, T2CCU_CC0LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+	/**
+	 * The position of the next capture to read.
+	 */
+	ubyte rpos;
 
-/**
- * The ISR for Capture events on channel PWC_CC0_P55.
- *
- * @private
- */
-void hsk_pwc_isr_cc0_p55(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[0].state = (P5_DATA >> 5) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(0, T2CCU_CC0LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+	/**
+	 * The position to write the next capture to.
+	 */
+	ubyte wpos;
 
-/**
- * The ISR for Capture events on channel PWC_CC1_P32.
- *
- * @private
- */
-void hsk_pwc_isr_cc1_p32(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[1].state = (P3_DATA >> 2) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(1, T2CCU_CC1LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+	/**
+	 * The number of captures lost due to a full buffer.
+	 */
+	ubyte lost;
 
-/**
- * The ISR for Capture events on channel PWC_CC1_P41.
- *
- * @private
- */
-void hsk_pwc_isr_cc1_p41(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[1].state = (P4_DATA >> 1) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(1, T2CCU_CC1LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+	/**
+	 * Set if raw captures are recorded.
+	 */
+	ubyte open;
+} xdata raws[PWC_CHANNELS];
 
 /**
- * The ISR for Capture events on channel PWC_CC1_P56.
+ * Records a raw capture in the ring buffer of a channel.
  *
+ * @param index
+ *	The channel that was captured
  * @private
  */
-void hsk_pwc_isr_cc1_p56(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[1].state = (P5_DATA >> 6) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(1, T2CCU_CC1LH);
-	SFR_PAGE(_t2_2, RST1);
+#define PWC_RAW_RECORD(index) { \
+	if (raws[index].open) { \
+		if (((raws[index].wpos + 1) & (PWC_RAW_SIZE - 1)) != raws[index].rpos) { \
+			raws[index].buffer[raws[index].wpos] = channels[index].lastCapture; \
+			raws[index].wpos = (raws[index].wpos + 1) & (PWC_RAW_SIZE - 1); \
+		} else if (raws[index].lost < 0xff) { \
+			raws[index].lost++; \
+		} \
+	} \
 }
 
-/**
- * The ISR for Capture events on channel PWC_CC2_P33.
- *
- * @private
- */
-void hsk_pwc_isr_cc2_p33(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[2].state = (P3_DATA >> 3) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(2, T2CCU_CC2LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+#else /* HSK_PWC_RAW */
 
 /**
- * The ISR for Capture events on channel PWC_CC2_P44.
+ * Records a raw capture in the ring buffer of a channel.
  *
+ * @param index
+ *	The channel that was captured
  * @private
  */
-void hsk_pwc_isr_cc2_p44(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[2].state = (P4_DATA >> 4) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(2, T2CCU_CC2LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+#define PWC_RAW_RECORD(index)
 
-/**
- * The ISR for Capture events on channel PWC_CC2_P52.
- *
- * @private
+#endif /* HSK_PWC_RAW */
+
+/** \var inputs
+ * The input pins of the channels, sampled by the capture ISR.
  */
-void hsk_pwc_isr_cc2_p52(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[2].state = (P5_DATA >> 2) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_2, SST1);
-	hsk_pwc_isr_ccn(2, T2CCU_CC2LH);
-	SFR_PAGE(_t2_2, RST1);
-}
+static struct {
+	/**
+	 * The input port, 0 for P3, 1 for P4 and 2 for P5.
+	 */
+	ubyte port;
 
+	/**
+	 * The pin of the input port.
+	 */
+	ubyte pin;
+} xdata inputs[PWC_CHANNELS];
 
 /**
- * The ISR for Capture events on channel PWC_CC3_P34.
+ * This is the common implementation of capture events.
  *
- * @private
- */
-void hsk_pwc_isr_cc3_p34(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[3].state = (P3_DATA >> 4) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_3, SST1);
-	hsk_pwc_isr_ccn(3, T2CCU_CC3LH);
-	SFR_PAGE(_t2_3, RST1);
-}
-
-/**
- * The ISR for Capture events on channel PWC_CC3_P45.
+ * It is expanded in the capture ISR and for soft capture events, because
+ * they use different register banks.
  *
+ * @param index
+ *	The channel that was captured
+ * @param capture
+ *	An uword lvalue holding the value that was captured, it is
+ *	overwritten
  * @private
  */
-void hsk_pwc_isr_cc3_p45(void) using 1 {
-	SFR_PAGE(_pp0, SST1);
-	channels[3].state = (P4_DATA >> 5) & 1;
-	SFR_PAGE(_pp0, RST1);
-	SFR_PAGE(_t2_3, SST1);
-	hsk_pwc_isr_ccn(3, T2CCU_CC3LH);
-	SFR_PAGE(_t2_3, RST1);
+#define PWC_CAPTURE(index, capture) { \
+	/* Get the new value and store the current capture value for next \
+	 * time. */ \
+	capture -= channels[index].lastCapture; \
+	channels[index].lastCapture += capture; \
+	/* Update the sum and buffer. */ \
+	channels[index].sum -= channels[index].buffer[channels[index].pos]; \
+	channels[index].buffer[channels[index].pos++] = capture; \
+	channels[index].pos %= channels[index].averageOver; \
+	channels[index].sum += capture; \
+	/* Update the overflow count. */ \
+	channels[index].overflow = overflows; \
+	/* Update the invalidation count. */ \
+	if (channels[index].invalid) { \
+		channels[index].invalid--; \
+	} \
+	/* Invalidate snapshots taken during the update. */ \
+	channels[index].seq++; \
+	/* Record the raw capture. */ \
+	PWC_RAW_RECORD(index); \
 }
 
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
 /**
- * The ISR for Capture events on channel PWC_CC3_P57.
+ * The ISR for Capture events on all channels.
+ *
+ * It is called once by the shared ISR for all pending capture events, so
+ * simultaneous events on several channels are served in a single pass.
  *
+ * @param events
+ *	The pending capture events, bit 0 represents PWC_CC0
  * @private
  */
-void hsk_pwc_isr_cc3_p57(void) using 1 {
+void hsk_pwc_isr_cc(const ubyte events) using 1 {
+	ubyte ports[3];
+	uword captures[PWC_CHANNELS];
+	uword capture;
+	ubyte channel;
+
+	/* Sample the input pins. */
 	SFR_PAGE(_pp0, SST1);
-	channels[3].state = (P5_DATA >> 7) & 1;
+	ports[0] = P3_DATA;
+	ports[1] = P4_DATA;
+	ports[2] = P5_DATA;
 	SFR_PAGE(_pp0, RST1);
+
+	/* Get the captured values. */
+	SFR_PAGE(_t2_2, SST1);
+	captures[0] = T2CCU_CC0LH;
+	captures[1] = T2CCU_CC1LH;
+	captures[2] = T2CCU_CC2LH;
+	SFR_PAGE(_t2_2, RST1);
 	SFR_PAGE(_t2_3, SST1);
-	hsk_pwc_isr_ccn(3, T2CCU_CC3LH);
+	captures[3] = T2CCU_CC3LH;
 	SFR_PAGE(_t2_3, RST1);
-}
 
+	/* Update the captured channels. */
+	for (channel = 0; channel < PWC_CHANNELS; channel++) {
+		if ((events >> channel) & 1) {
+			channels[channel].state = (ports[inputs[channel].port] >> inputs[channel].pin) & 1;
+			capture = captures[channel];
+			PWC_CAPTURE(channel, capture);
+		}
+	}
+}
 
 /**
  * The ISR for Capture/Compare overflow events.
@@ -323,25 +350,58 @@ void hsk_pwc_isr_cctOverflow(void) using 1 {
  * @private
  */
 void hsk_pwc_ccn(const hsk_pwc_channel channel, uword capture) {
-	#define channel    channels[channel]
-	/* Get the new value and store the current capture value for next
-	 * time. */
-	capture -= channel.lastCapture;
-	channel.lastCapture += capture;
-	/* Update the sum and buffer. */
-	channel.sum -= channel.buffer[channel.pos];
-	channel.buffer[channel.pos++] = capture;
-	channel.pos %= channel.averageOver;
-	channel.sum += capture;
-	/* Update the overflow count.. */
-	channel.overflow = overflows;
-	/* Update the invalidation count. */
-	if (channel.invalid) {
-		channel.invalid--;
+	PWC_CAPTURE(channel, capture);
+}
+
+/**
+ * Calculates a conversion factor.
+ *
+ * @param factor
+ *	The factor to set
+ * @param num
+ *	The numerator of the factor
+ * @param den
+ *	The denominator of the factor
+ * @private
+ */
+void hsk_pwc_factor_set(hsk_pwc_factor xdata * const factor, ulong num,
+                        const ulong den) {
+	factor->shift = 0;
+	while (num / den < (1 << 11) && num < (1ul << 30)) {
+		num <<= 1;
+		factor->shift++;
 	}
-	#undef channel
+	factor->mul = (num + den / 2) / den;
 }
 
+/**
+ * The numerators of the time unit conversion factors.
+ */
+static const uword code timeNum[PWC_TIME_UNITS] = {1, 1000, 1, 1};
+
+/**
+ * The denominators of the time unit conversion factors.
+ */
+static const uword code timeDen[PWC_TIME_UNITS] = {1, 48, 48, 48000};
+
+/**
+ * Calculates the conversion factors of a channel.
+ *
+ * @param channel
+ *	The channel to update the factors for
+ * @private
+ */
+void hsk_pwc_factors(const hsk_pwc_channel channel) {
+	ubyte count = channels[channel].averageOver;
+	ubyte i;
+
+	for (i = 1; i < PWC_TIME_UNITS; i++) {
+		hsk_pwc_factor_set(&factors.widths[channel][i - 1],
+		                   (ulong)timeNum[i] << prescaler,
+		                   (ulong)timeDen[i] * count);
+	}
+	factors.freqS[channel] = (48000000ul * count) >> prescaler;
+}
 
 /**
  * CR_MISC Timer 2 Capture/Compare Unit Clock Configuration bit.
@@ -384,6 +444,8 @@ void hsk_pwc_ccn(const hsk_pwc_channel channel, uword capture) {
 #define BIT_IMODE            4
 
 void hsk_pwc_init(ulong window) {
+	ubyte i;
+
 	/* The prescaler in powers of 2. */
 	prescaler = 0;
 
@@ -397,6 +459,21 @@ void hsk_pwc_init(ulong window) {
 	for (; prescaler < 12 && window >= (1ul << 16);
 		prescaler++, window >>= 1);
 
+	/*
+	 * Update the conversion factors for the prescaler.
+	 */
+	for (i = 0; i < PWC_TIME_UNITS; i++) {
+		hsk_pwc_factor_set(&factors.duty[i],
+		                   (ulong)timeNum[i] << prescaler,
+		                   timeDen[i]);
+	}
+	factors.freqM = (48000000ul * 60) >> prescaler;
+	for (i = 0; i < PWC_CHANNELS; i++) {
+		if ((opened >> i) & 1) {
+			hsk_pwc_factors(i);
+		}
+	}
+
 	/*
 	 * Set the prescaler.
 	 */
@@ -458,8 +535,13 @@ void hsk_pwc_channel_open(const hsk_pwc_channel channel,
 		averageOver = 1;
 	}
 	memset(&channels[channel], 0, sizeof(channels[channel]));
+#ifdef HSK_PWC_RAW
+	memset(&raws[channel], 0, sizeof(raws[channel]));
+#endif
 	channels[channel].averageOver = averageOver;
 	channels[channel].invalid = averageOver + 1;
+	hsk_pwc_factors(channel);
+	opened |= 1 << channel;
 
 	/**
 	 * Set the PWC capture mode.
@@ -538,65 +620,16 @@ const struct {
 
 void hsk_pwc_port_open(const hsk_pwc_port port,
                        ubyte __xdata averageOver) {
-	hsk_pwc_channel channel;
+	/* The ports are ordered by channel. */
+	hsk_pwc_channel channel = port / 3;
 
 	/*
-	 * Select the channel connected to the port.
+	 * Hook the channel into the capture ISR.
 	 */
-	switch(port) {
-	case PWC_CC0_P30:
-		hsk_isr9.EXINT3 = &hsk_pwc_isr_cc0_p30;
-		channel = PWC_CC0;
-		break;
-	case PWC_CC0_P40:
-		hsk_isr9.EXINT3 = &hsk_pwc_isr_cc0_p40;
-		channel = PWC_CC0;
-		break;
-	case PWC_CC0_P55:
-		hsk_isr9.EXINT3 = &hsk_pwc_isr_cc0_p55;
-		channel = PWC_CC0;
-		break;
-	case PWC_CC1_P32:
-		hsk_isr9.EXINT4 = &hsk_pwc_isr_cc1_p32;
-		channel = PWC_CC1;
-		break;
-	case PWC_CC1_P41:
-		hsk_isr9.EXINT4 = &hsk_pwc_isr_cc1_p41;
-		channel = PWC_CC1;
-		break;
-	case PWC_CC1_P56:
-		hsk_isr9.EXINT4 = &hsk_pwc_isr_cc1_p56;
-		channel = PWC_CC1;
-		break;
-	case PWC_CC2_P33:
-		hsk_isr9.EXINT5 = &hsk_pwc_isr_cc2_p33;
-		channel = PWC_CC2;
-		break;
-	case PWC_CC2_P44:
-		hsk_isr9.EXINT5 = &hsk_pwc_isr_cc2_p44;
-		channel = PWC_CC2;
-		break;
-	case PWC_CC2_P52:
-		hsk_isr9.EXINT5 = &hsk_pwc_isr_cc2_p52;
-		channel = PWC_CC2;
-		break;
-	case PWC_CC3_P34:
-		hsk_isr9.EXINT6 = &hsk_pwc_isr_cc3_p34;
-		channel = PWC_CC3;
-		break;
-	case PWC_CC3_P45:
-		hsk_isr9.EXINT6 = &hsk_pwc_isr_cc3_p45;
-		channel = PWC_CC3;
-		break;
-	case PWC_CC3_P57:
-		hsk_isr9.EXINT6 = &hsk_pwc_isr_cc3_p57;
-		channel = PWC_CC3;
-		break;
-	default:
-		/* That should not happen. */
-		channel = PWC_CC0;
-		break;
-	}
+	inputs[channel].port = port % 3;
+	inputs[channel].pin = hsk_pwc_ports[port].portBit;
+	hsk_isr9.T2CC = &hsk_pwc_isr_cc;
+	hsk_isr9.T2CCmask |= 1 << channel;
 
 	/* Open the channel. */
 	hsk_pwc_channel_open(channel, averageOver);
@@ -677,6 +710,9 @@ void hsk_pwc_port_open(const hsk_pwc_port port,
 }
 
 void hsk_pwc_channel_close(const hsk_pwc_channel channel) {
+	opened &= ~(1 << channel);
+	hsk_isr9.T2CCmask &= ~(1 << channel);
+
 	/*
 	 * Deactivate the channel.
 	 */
@@ -813,39 +849,92 @@ void hsk_pwc_disable(void) {
 	SFR_PAGE(_su0, noSST);
 }
 
-ulong hsk_pwc_channel_getValue(const hsk_pwc_channel channel,
-                               const ubyte unit) {
+void hsk_pwc_channel_snapshot(const hsk_pwc_channel channel,
+                              hsk_pwc_snapshot * const snapshot) {
 	#define channel    channels[channel]
-	ulong result;
+	ubyte seq, pos;
+
+	do {
+		seq = channel.seq;
+		snapshot->sum = channel.sum;
+		snapshot->lastCapture = channel.lastCapture;
+		snapshot->count = channel.averageOver;
+		snapshot->overflow = channel.overflow;
+		snapshot->invalid = channel.invalid;
+		snapshot->state = channel.state;
+		/* Get the latest two buffered values. */
+		pos = channel.pos ? channel.pos - 1 : channel.averageOver - 1;
+		snapshot->latest = channel.buffer[pos];
+		pos = pos ? pos - 1 : channel.averageOver - 1;
+		snapshot->previous = channel.buffer[pos];
+	} while (seq != channel.seq);
+	#undef channel
+}
+
+#ifdef HSK_PWC_RAW
+
+void hsk_pwc_channel_rawOpen(const hsk_pwc_channel channel) {
+	raws[channel].rpos = raws[channel].wpos;
+	raws[channel].lost = 0;
+	raws[channel].open = 1;
+}
+
+void hsk_pwc_channel_rawClose(const hsk_pwc_channel channel) {
+	raws[channel].open = 0;
+}
+
+ubyte hsk_pwc_channel_rawRead(const hsk_pwc_channel channel,
+                              uword * const captures, const ubyte count) {
+	#define raw    raws[channel]
+	ubyte i;
+
+	for (i = 0; i < count && raw.rpos != raw.wpos; i++) {
+		captures[i] = raw.buffer[raw.rpos];
+		raw.rpos = (raw.rpos + 1) & (PWC_RAW_SIZE - 1);
+	}
+	return i;
+	#undef raw
+}
+
+ubyte hsk_pwc_channel_rawLost(const hsk_pwc_channel channel) {
 	bool ea = EA;
-	bool exm = EXM;
-	bool et2 = ET2;
-	ubyte overflow;
+	ubyte lost;
 
-	/* Get the current timer data, make this quick. */
-	SFR_PAGE(_t2_1, noSST);
+	/* The capture may increment the counter in between. */
 	EA = 0;
-	EXM = 0;
-	ET2 = 0;
+	lost = raws[channel].lost;
+	raws[channel].lost = 0;
 	EA = ea;
+	return lost;
+}
+
+#endif /* HSK_PWC_RAW */
+
+ulong hsk_pwc_channel_getValue(const hsk_pwc_channel channel,
+                               const ubyte unit) {
+	hsk_pwc_snapshot snapshot;
+	ulong result;
+	ubyte overflow;
+
+	/* Get a consistent copy of the channel data. */
+	hsk_pwc_channel_snapshot(channel, &snapshot);
+
 	/* Get the age of the last capture event. */
-	overflow = overflows - channel.overflow;
+	SFR_PAGE(_t2_1, noSST);
+	overflow = overflows - snapshot.overflow;
 	/* Captures shortly before and after an overflow may have an off by
 	 * one overflow count. */
-	if (overflow && T2CCU_CCTLH < (channel.lastCapture - 0x100)) {
+	if (overflow && T2CCU_CCTLH < (snapshot.lastCapture - 0x100)) {
 		overflow--;
 	}
+	SFR_PAGE(_t2_0, noSST);
 	/* Check whether the window time frame has been left. */
 	if (overflow) {
-		channel.invalid = channel.averageOver + 1;
+		channels[channel].invalid = snapshot.count + 1;
+		return 0;
 	}
-	SFR_PAGE(_t2_0, noSST);
 	/* Return 0 for invalid channels. */
-	if (channel.invalid) {
-		EA = 0;
-		EXM = exm;
-		ET2 = et2;
-		EA = ea;
+	if (snapshot.invalid) {
 		return 0;
 	}
 
@@ -854,92 +943,57 @@ ulong hsk_pwc_channel_getValue(const hsk_pwc_channel channel,
 	 */
 	switch(unit) {
 	case PWC_UNIT_SUM_RAW:
-		result = channel.sum << prescaler;
+		result = snapshot.sum << prescaler;
 		break;
 	case PWC_UNIT_WIDTH_RAW:
-		result = (channel.sum << prescaler)
-			/ channel.averageOver;
+		/* The fixed point factor is not exact. */
+		result = (snapshot.sum << prescaler) / snapshot.count;
 		break;
 	case PWC_UNIT_WIDTH_NS:
-		result = (channel.sum << prescaler)
-			* 250 / 12 / channel.averageOver;
-		break;
 	case PWC_UNIT_WIDTH_US:
-		result = (channel.sum << prescaler)
-			/ 48 / channel.averageOver;
-		break;
 	case PWC_UNIT_WIDTH_MS:
-		result = (channel.sum << prescaler)
-			/ 48000 / channel.averageOver;
+		#define factor    factors.widths[channel][unit - PWC_UNIT_WIDTH_NS]
+		result = (snapshot.sum * factor.mul) >> factor.shift;
+		#undef factor
 		break;
 	case PWC_UNIT_FREQ_S:
-		result = (48000000ul * channel.averageOver
-			/ channel.sum) >> prescaler;
+		result = factors.freqS[channel] / snapshot.sum;
 		break;
 	case PWC_UNIT_FREQ_M:
-		result = ((48000000ul * 60) >> prescaler)
-			/ channel.sum * channel.averageOver;
+		result = factors.freqM / snapshot.sum * snapshot.count;
 		break;
 	case PWC_UNIT_FREQ_H:
-		result = ((48000000ul * 60) >> prescaler)
-			/ channel.sum * 60 * channel.averageOver;
+		result = factors.freqM / snapshot.sum * 60 * snapshot.count;
 		break;
 	case PWC_UNIT_DUTYH_RAW:
-		result = channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - channel.state)
-		                        % channel.averageOver]
-		         << prescaler;
-		break;
 	case PWC_UNIT_DUTYH_NS:
-		result = (channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - channel.state)
-		                        % channel.averageOver]
-		          << prescaler) * 250 / 12;
-		break;
 	case PWC_UNIT_DUTYH_US:
-		result = (channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - channel.state)
-		                        % channel.averageOver]
-		          << prescaler) / 48;
-		break;
 	case PWC_UNIT_DUTYH_MS:
-		result = (channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - channel.state)
-		                        % channel.averageOver]
-		          << prescaler) / 48000;
+		#define factor    factors.duty[unit - PWC_UNIT_DUTYH_RAW]
+		result = ((ulong)(snapshot.state ? snapshot.previous : snapshot.latest)
+		          * factor.mul) >> factor.shift;
+		#undef factor
 		break;
 	case PWC_UNIT_DUTYL_RAW:
-		result = channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - (channel.state ^ 1))
-		                        % channel.averageOver]
-		         << prescaler;
-		break;
 	case PWC_UNIT_DUTYL_NS:
-		result = (channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - (channel.state ^ 1))
-		                        % channel.averageOver]
-		          << prescaler) * 250 / 12;
-		break;
 	case PWC_UNIT_DUTYL_US:
-		result = (channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - (channel.state ^ 1))
-		                        % channel.averageOver]
-		          << prescaler) / 48;
-		break;
 	case PWC_UNIT_DUTYL_MS:
-		result = (channel.buffer[(channel.pos + channel.averageOver
-		                         - 1 - (channel.state ^ 1))
-		                        % channel.averageOver]
-		          << prescaler) / 48000;
+		#define factor    factors.duty[unit - PWC_UNIT_DUTYL_RAW]
+		result = ((ulong)(snapshot.state ? snapshot.latest : snapshot.previous)
+		          * factor.mul) >> factor.shift;
+		#undef factor
 		break;
 	default:
 		result = 0;
 	}
-	EA = 0;
-	EXM = exm;
-	ET2 = et2;
-	EA = ea;
 	return result;
-	#undef channel
 }
 
+void hsk_pwc_getValues(const ubyte unit, ulong * const values) {
+	hsk_pwc_channel channel;
+
+	for (channel = 0; channel < PWC_CHANNELS; channel++) {
+		values[channel] = (opened >> channel) & 1
+		                  ? hsk_pwc_channel_getValue(channel, unit) : 0;
+	}
+}
@@ -19,6 +19,20 @@
  * hsk_pwc_channel_getValue() function has to be called at least once every
  * 256 window times.
  *
+ * Channel data is read with hsk_pwc_channel_snapshot(), which retries
+ * instead of masking the capture interrupts, if a capture occurs while
+ * copying. So reading channels does not delay captures on other channels.
+ *
+ * Consumers that want to do their own processing can record the raw
+ * capture timestamps of a channel in a ring buffer, see
+ * hsk_pwc_channel_rawOpen(). The ring buffers take PWC_CHANNELS *
+ * (2 * PWC_RAW_SIZE + 4) bytes of xdata, so they are only available if
+ * the library is built with HSK_PWC_RAW defined.
+ *
+ * Unit conversions are done with fixed point factors, which are calculated
+ * when a channel is opened or the window is changed. Only frequencies and
+ * raw average widths, which have to be exact, still require a division.
+ *
  * @author kami
  */
 
@@ -122,6 +136,69 @@ typedef ubyte hsk_pwc_port;
  */
 #define PWC_CC3_P57           11
 
+/**
+ * The number of available PWC channels.
+ */
+#define PWC_CHANNELS          4
+
+#ifdef HSK_PWC_RAW
+
+/**
+ * The size of the raw capture ring buffer of a channel, has to be a power
+ * of 2.
+ *
+ * The buffer holds up to PWC_RAW_SIZE - 1 captures.
+ */
+#define PWC_RAW_SIZE          16
+
+#endif /* HSK_PWC_RAW */
+
+/**
+ * A consistent copy of the channel data.
+ */
+typedef struct {
+	/**
+	 * The sum of the buffered pulse widths in CCT ticks.
+	 */
+	ulong sum;
+
+	/**
+	 * The CCT value of the last capture.
+	 */
+	uword lastCapture;
+
+	/**
+	 * The latest pulse width in CCT ticks.
+	 */
+	uword latest;
+
+	/**
+	 * The previous pulse width in CCT ticks.
+	 */
+	uword previous;
+
+	/**
+	 * The number of pulse widths in the sum.
+	 */
+	ubyte count;
+
+	/**
+	 * The CCT overflow count of the last capture.
+	 */
+	ubyte overflow;
+
+	/**
+	 * The number of captures required to make the channel valid.
+	 */
+	ubyte invalid;
+
+	/**
+	 * The input pin state at the last capture, 0 means the latest
+	 * pulse was a high pulse.
+	 */
+	ubyte state;
+} hsk_pwc_snapshot;
+
 /**
  * Configuration selection to trigger pulse detection on falling edge.
  */
@@ -424,5 +501,81 @@ void hsk_pwc_disable(void);
 ulong hsk_pwc_channel_getValue(const hsk_pwc_channel channel,
                                const ubyte unit);
 
+/**
+ * Returns the values of all channels in the requested unit.
+ *
+ * Closed channels are reported as 0.
+ *
+ * @param unit
+ *	The unit to return the channel values in
+ * @param values
+ *	An array of PWC_CHANNELS values to write to
+ */
+void hsk_pwc_getValues(const ubyte unit, ulong * const values);
+
+/**
+ * Take a consistent snapshot of the channel data.
+ *
+ * The capture interrupts are not masked, instead the copy is repeated
+ * if a capture occurred while copying.
+ *
+ * @param channel
+ *	The channel to copy
+ * @param snapshot
+ *	The snapshot to write to
+ */
+void hsk_pwc_channel_snapshot(const hsk_pwc_channel channel,
+                              hsk_pwc_snapshot * const snapshot);
+
+#ifdef HSK_PWC_RAW
+
+/**
+ * Start recording raw capture timestamps for a channel.
+ *
+ * The timestamps are the CCT values at the capture events, prescaled
+ * like all other raw values.
+ *
+ * Opening a channel stops recording.
+ *
+ * @param channel
+ *	The channel to record
+ */
+void hsk_pwc_channel_rawOpen(const hsk_pwc_channel channel);
+
+/**
+ * Stop recording raw capture timestamps for a channel.
+ *
+ * @param channel
+ *	The channel to stop recording
+ */
+void hsk_pwc_channel_rawClose(const hsk_pwc_channel channel);
+
+/**
+ * Read recorded raw capture timestamps.
+ *
+ * @param channel
+ *	The channel to read the timestamps of
+ * @param captures
+ *	The buffer to copy the timestamps to
+ * @param count
+ *	The maximum number of timestamps to copy
+ * @return
+ *	The number of timestamps copied
+ */
+ubyte hsk_pwc_channel_rawRead(const hsk_pwc_channel channel,
+                              uword * const captures, const ubyte count);
+
+/**
+ * Returns and resets the number of timestamps lost due to a full buffer.
+ *
+ * @param channel
+ *	The channel to check
+ * @return
+ *	The number of lost timestamps
+ */
+ubyte hsk_pwc_channel_rawLost(const hsk_pwc_channel channel);
+
+#endif /* HSK_PWC_RAW */
+
 #endif /* _HSK_PWC_H_ */
 
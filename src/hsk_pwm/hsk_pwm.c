@@ -8,6 +8,11 @@
  * generating PWM. Also, the channels PWM_60, PWM_61 and PWM_62 operate at
  * the same base frequency and period. This is a hardware limitation.
  *
+ * Ramps and tables are advanced by the T12 and T13 period match
+ * interrupts, which are routed to the CCU6 interrupt nodes 0 and 1.
+ * The period match interrupts are only enabled while a channel of the
+ * timer is driven.
+ *
  * @author kami
  */
 
@@ -77,6 +82,164 @@
  */
 #define BIT_TnSTR      6
 
+/**
+ * CCU6_TCTR4L/CCU6_TCTR4H Timer T12/T13 Shadow Transfer Disable bit.
+ */
+#define BIT_TnSTD      7
+
+/**
+ * The number of PWM channels.
+ */
+#define PWM_CHANNELS   4
+
+/**
+ * The number of fraction bits of the duty cycle scaling factors.
+ */
+#define SHIFT_FACTOR   15
+
+/** \var scales
+ * The duty cycle scaling of every channel.
+ */
+static struct {
+	/**
+	 * The max value the factor was calculated for, 0 if the factor
+	 * is invalid.
+	 */
+	uword max;
+
+	/**
+	 * The PWM period in timer counts.
+	 */
+	ulong period;
+
+	/**
+	 * The factor to scale duty cycle values, with SHIFT_FACTOR
+	 * fraction bits.
+	 */
+	ulong factor;
+} xdata scales[PWM_CHANNELS];
+
+/**
+ * SYSCON0 Special Function Register Map Control bit.
+ */
+#define BIT_RMAP       0
+
+/**
+ * CCU6_IENL Enable Interrupt for T12 Period-Match bit.
+ */
+#define BIT_ENT12PM    7
+
+/**
+ * CCU6_IENH Enable Interrupt for T13 Period-Match bit.
+ */
+#define BIT_ENT13PM    1
+
+/**
+ * CCU6_INPH Interrupt Node Pointer for Timer T12 Interrupts bits.
+ */
+#define BIT_INPT12     2
+
+/**
+ * CCU6_INPH Interrupt Node Pointer for Timer T13 Interrupts bits.
+ */
+#define BIT_INPT13     4
+
+/**
+ * INPTn bit count.
+ */
+#define CNT_INPTn      2
+
+/**
+ * CCU6_ISRL Reset T12 Period-Match Flag bit.
+ */
+#define BIT_RT12PM     7
+
+/**
+ * CCU6_ISRH Reset T13 Period-Match Flag bit.
+ */
+#define BIT_RT13PM     1
+
+/**
+ * The channel is not driven by the ISRs.
+ */
+#define MODE_NONE      0
+
+/**
+ * The channel duty cycle moves towards a target.
+ */
+#define MODE_RAMP      1
+
+/**
+ * The channel duty cycle is taken from a table.
+ */
+#define MODE_TABLE     2
+
+/** \var ramps
+ * The ISR driven duty cycle changes of every channel.
+ *
+ * The ISRs ignore a channel with mode MODE_NONE, so the mode has to be
+ * set to MODE_NONE before changing any other member.
+ */
+static volatile struct {
+	/**
+	 * The waveform table of MODE_TABLE.
+	 */
+	const ubyte code * table;
+
+	/**
+	 * The last compare value written to the channel.
+	 */
+	uword duty;
+
+	/**
+	 * The compare value a ramp ends at.
+	 */
+	uword target;
+
+	/**
+	 * The compare value change per period of a ramp.
+	 */
+	uword step;
+
+	/**
+	 * The period register value to scale table entries with.
+	 */
+	uword top;
+
+	/**
+	 * The number of table entries.
+	 */
+	ubyte length;
+
+	/**
+	 * The next table entry.
+	 */
+	ubyte pos;
+
+	/**
+	 * The number of periods each table entry is held.
+	 */
+	ubyte divider;
+
+	/**
+	 * The number of periods until the next table entry.
+	 */
+	ubyte count;
+
+	/**
+	 * The current mode, one of MODE_NONE, MODE_RAMP or MODE_TABLE.
+	 */
+	ubyte mode;
+} xdata ramps[PWM_CHANNELS];
+
+/** \var written
+ * Set by hsk_pwm_isr_advance() when it writes a compare value.
+ *
+ * Functions using a register bank cannot reliably return values, so
+ * the result is passed this way.
+ */
+static ubyte pdata written;
+
 void hsk_pwm_init(const hsk_pwm_channel channel, const ulong freq) {
 	/**
 	 * <b>PWM Timings</b>
@@ -138,6 +301,17 @@ void hsk_pwm_init(const hsk_pwm_channel channel, const ulong freq) {
 	case PWM_60:
 	case PWM_61:
 	case PWM_62:
+		/* Invalidate the duty cycle scaling. */
+		scales[PWM_60].max = 0;
+		scales[PWM_61].max = 0;
+		scales[PWM_62].max = 0;
+		/* Stop ramps and tables. */
+		ramps[PWM_60].mode = MODE_NONE;
+		ramps[PWM_61].mode = MODE_NONE;
+		ramps[PWM_62].mode = MODE_NONE;
+		ramps[PWM_60].duty = 0;
+		ramps[PWM_61].duty = 0;
+		ramps[PWM_62].duty = 0;
 		/* Set the timer T12 prescaler. */
 		CCU6_TCTR0L = (prescaler << BIT_TnCLK);
 
@@ -160,6 +334,10 @@ void hsk_pwm_init(const hsk_pwm_channel channel, const ulong freq) {
 		CCU6_T12MSELL = MOD_MSEL6n << CNT_MSEL6n | MOD_MSEL6n;
 		CCU6_T12MSELH = CCU6_T12MSELH & ~((1 << CNT_MSEL6n) - 1) | MOD_MSEL6n;
 
+		/* Route T12 interrupts to node 0. */
+		CCU6_IENL &= ~(1 << BIT_ENT12PM);
+		CCU6_INPH &= ~(((1 << CNT_INPTn) - 1) << BIT_INPT12);
+
 		/*
 		 * Make sure the PWM comes up clean by setting all duty cycles to 0.
 		 */
@@ -172,6 +350,11 @@ void hsk_pwm_init(const hsk_pwm_channel channel, const ulong freq) {
 		CCU6_TCTR4L = 1 << BIT_TnSTR;
 		break;
 	case PWM_63:
+		/* Invalidate the duty cycle scaling. */
+		scales[PWM_63].max = 0;
+		/* Stop ramps and tables. */
+		ramps[PWM_63].mode = MODE_NONE;
+		ramps[PWM_63].duty = 0;
 		/* Set the timer T13 prescaler. */
 		CCU6_TCTR0H = (prescaler << BIT_TnCLK);
 
@@ -190,6 +373,10 @@ void hsk_pwm_init(const hsk_pwm_channel channel, const ulong freq) {
 		/* Enable timer T13 output. */
 		CCU6_MODCTRH |= 1 << BIT_ECT13O;
 
+		/* Route T13 interrupts to node 1. */
+		CCU6_IENH &= ~(1 << BIT_ENT13PM);
+		CCU6_INPH = CCU6_INPH & ~(((1 << CNT_INPTn) - 1) << BIT_INPT13) | (1 << BIT_INPT13);
+
 		/*
 		 * Make sure the PWM comes up clean by setting all duty cycles to 0.
 		 */
@@ -351,46 +538,314 @@ void hsk_pwm_port_close(const hsk_pwm_port port) {
 	#undef portSel
 }
 
-void hsk_pwm_channel_set(const hsk_pwm_channel channel,
-                         const uword max, const uword value) {
-	ulong duty;
+/**
+ * Returns the compare value for a duty cycle.
+ *
+ * The scaling factor for max is cached, so a division is only required
+ * when max changes.
+ *
+ * @param channel
+ *	The PWM channel to calculate the compare value for
+ * @param max
+ *	Defines the scope value can move in
+ * @param value
+ *	The duty cycle value
+ * @return
+ *	The compare value
+ * @private
+ */
+uword hsk_pwm_duty(const hsk_pwm_channel channel, const uword max,
+                   const uword value) {
+	#define scale scales[channel]
+	/* Update the scaling factor. */
+	if (scale.max != max) {
+		SFR_PAGE(_cc1, noSST);
+		if (channel == PWM_63) {
+			scale.period = (ulong)CCU6_T13PRLH + 1;
+		} else {
+			scale.period = (ulong)CCU6_T12PRLH + 1;
+		}
+		SFR_PAGE(_cc0, noSST);
+		scale.max = max;
+		scale.factor = ((scale.period << SHIFT_FACTOR) + (max >> 1)) / max;
+	}
 
-	/* Set the new cycle and request shadow transfer. */
-	SFR_PAGE(_cc1, noSST);
+	if (value >= max) {
+		return scale.period;
+	}
+	return (value * scale.factor) >> SHIFT_FACTOR;
+	#undef scale
+}
+
+/**
+ * Writes a compare value into the shadow register of a channel.
+ *
+ * @param channel
+ *	The PWM channel to write the compare value for
+ * @param duty
+ *	The compare value
+ * @private
+ */
+void hsk_pwm_channel_write(const hsk_pwm_channel channel, const uword duty) {
+	/* Keep the ISRs away from the channel. */
+	ramps[channel].mode = MODE_NONE;
+	ramps[channel].duty = duty;
+	SFR_PAGE(_cc0, noSST);
 	switch (channel) {
 	case PWM_60:
-		/* Calculate the duty cycle. */
-		duty = (ulong)(CCU6_T12PRLH + 1) * value / max;
-		/* Write the duty cycle. */
-		SFR_PAGE(_cc0, noSST);
 		CCU6_CC60SRLH = duty;
-		CCU6_TCTR4L = 1 << BIT_TnSTR;
 		break;
 	case PWM_61:
-		/* Calculate the duty cycle. */
-		duty = (ulong)(CCU6_T12PRLH + 1) * value / max;
-		/* Write the duty cycle. */
-		SFR_PAGE(_cc0, noSST);
 		CCU6_CC61SRLH = duty;
-		CCU6_TCTR4L = 1 << BIT_TnSTR;
 		break;
 	case PWM_62:
-		/* Calculate the duty cycle. */
-		duty = (ulong)(CCU6_T12PRLH + 1) * value / max;
-		/* Write the duty cycle. */
-		SFR_PAGE(_cc0, noSST);
 		CCU6_CC62SRLH = duty;
-		CCU6_TCTR4L = 1 << BIT_TnSTR;
 		break;
 	case PWM_63:
-		/* Calculate the duty cycle. */
-		duty = (ulong)(CCU6_T13PRLH + 1) * value / max;
-		/* Write the duty cycle. */
-		SFR_PAGE(_cc0, noSST);
 		CCU6_CC63SRLH = duty;
+		break;
+	}
+}
+
+void hsk_pwm_channel_set(const hsk_pwm_channel channel,
+                         const uword max, const uword value) {
+	/* Set the new cycle and request shadow transfer. */
+	hsk_pwm_channel_write(channel, hsk_pwm_duty(channel, max, value));
+	if (channel == PWM_63) {
 		CCU6_TCTR4H = 1 << BIT_TnSTR;
+	} else {
+		CCU6_TCTR4L = 1 << BIT_TnSTR;
+	}
+}
+
+void hsk_pwm_channel_stage(const hsk_pwm_channel channel,
+                           const uword max, const uword value) {
+	const uword duty = hsk_pwm_duty(channel, max, value);
+
+	/* Hold back pending shadow transfers until the commit, so they
+	 * cannot pick up an incomplete set of duty cycles. */
+	SFR_PAGE(_cc0, noSST);
+	if (channel == PWM_63) {
+		CCU6_TCTR4H = 1 << BIT_TnSTD;
+	} else {
+		CCU6_TCTR4L = 1 << BIT_TnSTD;
+	}
+	hsk_pwm_channel_write(channel, duty);
+}
+
+void hsk_pwm_commit(void) {
+	/* Request shadow transfer for T12 and T13 duty cycles. */
+	SFR_PAGE(_cc0, noSST);
+	CCU6_TCTR4L = 1 << BIT_TnSTR;
+	CCU6_TCTR4H = 1 << BIT_TnSTR;
+}
+
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+/**
+ * Advances the duty cycle of a channel driven by the period match ISRs.
+ *
+ * Sets \ref written if a new compare value was written.
+ *
+ * Table entries are scaled by shifting and adding, the multiplications
+ * of the runtime libraries are not safe to call from an ISR.
+ *
+ * @param channel
+ *	The PWM channel to advance
+ * @private
+ */
+void hsk_pwm_isr_advance(const hsk_pwm_channel channel) using 1 {
+	ubyte value, mask;
+	uword hi, lo;
+
+	#define ramp ramps[channel]
+	switch (ramp.mode) {
+	case MODE_RAMP:
+		if (ramp.duty < ramp.target) {
+			ramp.duty = ramp.target - ramp.duty > ramp.step ?
+			            ramp.duty + ramp.step : ramp.target;
+		} else {
+			ramp.duty = ramp.duty - ramp.target > ramp.step ?
+			            ramp.duty - ramp.step : ramp.target;
+		}
+		if (ramp.duty == ramp.target) {
+			ramp.mode = MODE_NONE;
+		}
+		break;
+	case MODE_TABLE:
+		if (ramp.count) {
+			ramp.count--;
+			return;
+		}
+		ramp.count = ramp.divider;
+		value = ramp.table[ramp.pos];
+		if (++ramp.pos >= ramp.length) {
+			ramp.pos = 0;
+		}
+		/* (top * value) >> 8, with 0xff for the full period. */
+		if (value == 0xff) {
+			ramp.duty = ramp.top + 1;
+			break;
+		}
+		hi = 0;
+		lo = 0;
+		for (mask = 0x80; mask; mask >>= 1) {
+			hi <<= 1;
+			lo <<= 1;
+			if (value & mask) {
+				hi += (ubyte)(ramp.top >> 8);
+				lo += (ubyte)ramp.top;
+			}
+		}
+		ramp.duty = hi + (lo >> 8);
+		break;
+	default:
+		return;
+	}
+
+	switch (channel) {
+	case PWM_60:
+		CCU6_CC60SRLH = ramp.duty;
+		break;
+	case PWM_61:
+		CCU6_CC61SRLH = ramp.duty;
+		break;
+	case PWM_62:
+		CCU6_CC62SRLH = ramp.duty;
+		break;
+	case PWM_63:
+		CCU6_CC63SRLH = ramp.duty;
 		break;
 	}
+	written = 1;
+	#undef ramp
+}
+#pragma restore
+
+/**
+ * The T12 period match ISR.
+ *
+ * Advances the channels PWM_60, PWM_61 and PWM_62 and disables itself
+ * once none of them is driven any more.
+ *
+ * @private
+ */
+void ISR_hsk_pwm_t12(void) interrupt 10 using 1 {
+	bool rmap = (SYSCON0 >> BIT_RMAP) & 1;
+	RESET_RMAP();
+	SFR_PAGE(_cc0, SST0);
+
+	CCU6_ISRL = 1 << BIT_RT12PM;
+	written = 0;
+	hsk_pwm_isr_advance(PWM_60);
+	hsk_pwm_isr_advance(PWM_61);
+	hsk_pwm_isr_advance(PWM_62);
+	if (written) {
+		CCU6_TCTR4L = 1 << BIT_TnSTR;
+	}
+	if (ramps[PWM_60].mode == MODE_NONE && ramps[PWM_61].mode == MODE_NONE &&
+	    ramps[PWM_62].mode == MODE_NONE) {
+		SFR_PAGE(_cc2, noSST);
+		CCU6_IENL &= ~(1 << BIT_ENT12PM);
+	}
+
+	SFR_PAGE(_cc0, RST0);
+	rmap ? (SET_RMAP()) : (RESET_RMAP());
+}
+
+/**
+ * The T13 period match ISR.
+ *
+ * Advances the channel PWM_63 and disables itself once it is no longer
+ * driven.
+ *
+ * @private
+ */
+void ISR_hsk_pwm_t13(void) interrupt 11 using 1 {
+	bool rmap = (SYSCON0 >> BIT_RMAP) & 1;
+	RESET_RMAP();
+	SFR_PAGE(_cc0, SST0);
+
+	CCU6_ISRH = 1 << BIT_RT13PM;
+	written = 0;
+	hsk_pwm_isr_advance(PWM_63);
+	if (written) {
+		CCU6_TCTR4H = 1 << BIT_TnSTR;
+	}
+	if (ramps[PWM_63].mode == MODE_NONE) {
+		SFR_PAGE(_cc2, noSST);
+		CCU6_IENH &= ~(1 << BIT_ENT13PM);
+	}
+
+	SFR_PAGE(_cc0, RST0);
+	rmap ? (SET_RMAP()) : (RESET_RMAP());
+}
+
+/**
+ * Enables the period match interrupt of the timer driving a channel.
+ *
+ * @param channel
+ *	The PWM channel that is driven by the ISRs
+ * @private
+ */
+void hsk_pwm_isr_enable(const hsk_pwm_channel channel) {
+	SFR_PAGE(_cc2, noSST);
+	if (channel == PWM_63) {
+		CCU6_IENH |= 1 << BIT_ENT13PM;
+		ECCIP1 = 1;
+	} else {
+		CCU6_IENL |= 1 << BIT_ENT12PM;
+		ECCIP0 = 1;
+	}
+	SFR_PAGE(_cc0, noSST);
+}
+
+void hsk_pwm_channel_ramp(const hsk_pwm_channel channel, const uword max,
+                          const uword target, const uword step) {
+	const uword duty = hsk_pwm_duty(channel, max, target);
+	const uword counts = hsk_pwm_duty(channel, max, step);
+
+	#define ramp ramps[channel]
+	ramp.mode = MODE_NONE;
+	ramp.target = duty;
+	ramp.step = counts ? counts : 1;
+	if (ramp.duty == duty) {
+		return;
+	}
+	ramp.mode = MODE_RAMP;
+	#undef ramp
+	hsk_pwm_isr_enable(channel);
+}
+
+void hsk_pwm_channel_table(const hsk_pwm_channel channel,
+                           const ubyte code * const table,
+                           const ubyte length, const ubyte divider) {
+	#define ramp ramps[channel]
+	ramp.mode = MODE_NONE;
+	SFR_PAGE(_cc1, noSST);
+	if (channel == PWM_63) {
+		ramp.top = CCU6_T13PRLH;
+	} else {
+		ramp.top = CCU6_T12PRLH;
+	}
+	SFR_PAGE(_cc0, noSST);
+	ramp.table = table;
+	ramp.length = length;
+	ramp.pos = 0;
+	ramp.divider = divider ? divider - 1 : 0;
+	ramp.count = 0;
+	if (!length) {
+		return;
+	}
+	ramp.mode = MODE_TABLE;
+	#undef ramp
+	hsk_pwm_isr_enable(channel);
+}
+
+bool hsk_pwm_channel_active(const hsk_pwm_channel channel) {
+	return ramps[channel].mode != MODE_NONE;
 }
 
 void hsk_pwm_outChannel_dir(hsk_pwm_outChannel channel,
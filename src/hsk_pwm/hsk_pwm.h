@@ -28,12 +28,30 @@
  * - hsk_pwm_enable()
  * - hsk_pwm_port_open()
  *
+ * Duty cycles set with hsk_pwm_channel_set() take effect at the end of
+ * the current PWM period. To update several channels at the same time,
+ * stage their duty cycles with hsk_pwm_channel_stage() and apply them
+ * with hsk_pwm_commit().
+ *
+ * A channel can also be driven by the period match ISRs, without any
+ * involvement from the main loop. Use hsk_pwm_channel_ramp() to move
+ * the duty cycle towards a target or hsk_pwm_channel_table() to play
+ * back a waveform table. The ISRs only add and compare precalculated
+ * compare values, so they are cheap enough to run every PWM period.
+ *
  * @author kami
  */
 
 #ifndef _HSK_PWM_H_
 #define _HSK_PWM_H_
 
+/*
+ * ISR prototypes for SDCC.
+ */
+#ifdef SDCC
+#include "hsk_pwm.isr"
+#endif /* SDCC */
+
 /**
  * Type definition for PWM channels.
  */
@@ -270,6 +288,11 @@ void hsk_pwm_port_close(const hsk_pwm_port port);
  * To set the duty cycle in percent specify a max of 100 and values from 0 to
  * 100.
  *
+ * The scaling for max is cached per channel, so as long as max does not
+ * change, no division is required.
+ *
+ * This stops a ramp or table running on the channel.
+ *
  * @param channel
  *	The PWM channel to set the duty cycle for, check the PWM_6x defines
  * @param max
@@ -280,6 +303,92 @@ void hsk_pwm_port_close(const hsk_pwm_port port);
 void hsk_pwm_channel_set(const hsk_pwm_channel channel,
                          const uword max, const uword value);
 
+/**
+ * Stage the duty cycle for the given channel.
+ *
+ * Staged duty cycles take effect at the end of the PWM period after
+ * calling hsk_pwm_commit(). Pending changes from hsk_pwm_channel_set()
+ * of channels sharing the same timer are held back until then.
+ *
+ * @param channel
+ *	The PWM channel to set the duty cycle for, check the PWM_6x defines
+ * @param max
+ *	Defines the scope value can move in
+ * @param value
+ *	The current duty cycle value
+ */
+void hsk_pwm_channel_stage(const hsk_pwm_channel channel,
+                           const uword max, const uword value);
+
+/**
+ * Apply all staged duty cycles.
+ *
+ * The channels PWM_60, PWM_61 and PWM_62 are updated at the end of the
+ * same T12 period.
+ */
+void hsk_pwm_commit(void);
+
+/**
+ * Moves the duty cycle of a channel towards a target.
+ *
+ * The duty cycle changes by step at the end of every PWM period, starting
+ * from the last duty cycle written to the channel. Once the target is
+ * reached the channel is left alone.
+ *
+ * The period match ISRs request a shadow transfer when they change a
+ * duty cycle, which also applies staged duty cycles of channels on the
+ * same timer. So channels driven by the ISRs should not share a timer
+ * with staged channels.
+ *
+ * @param channel
+ *	The PWM channel to ramp, check the PWM_6x defines
+ * @param max
+ *	Defines the scope target and step can move in
+ * @param target
+ *	The duty cycle value to reach
+ * @param step
+ *	The duty cycle change per PWM period, at least 1 timer count is
+ *	used
+ */
+void hsk_pwm_channel_ramp(const hsk_pwm_channel channel, const uword max,
+                          const uword target, const uword step);
+
+/**
+ * Plays back a waveform table on a channel.
+ *
+ * The table entries are duty cycles in 1/256 of the period, except for
+ * 0xff, which is the full period. They repeat until the channel is set
+ * to a different duty cycle. The entries are scaled with the
+ * period of the channel, which has to be set up with hsk_pwm_init()
+ * before calling this.
+ *
+ * See hsk_pwm_channel_ramp() for the effect on staged channels.
+ *
+ * @param channel
+ *	The PWM channel to drive, check the PWM_6x defines
+ * @param table
+ *	The duty cycle table in code memory
+ * @param length
+ *	The number of table entries, at least 1
+ * @param divider
+ *	The number of PWM periods each entry is held, 0 is treated as 1
+ */
+void hsk_pwm_channel_table(const hsk_pwm_channel channel,
+                           const ubyte code * const table,
+                           const ubyte length, const ubyte divider);
+
+/**
+ * Returns whether a channel is driven by the period match ISRs.
+ *
+ * @param channel
+ *	The PWM channel to check, check the PWM_6x defines
+ * @retval 1
+ *	A ramp or table is running on the channel
+ * @retval 0
+ *	The channel keeps its duty cycle
+ */
+bool hsk_pwm_channel_active(const hsk_pwm_channel channel);
+
 /**
  * Set the direction of an output channel.
  *
@@ -0,0 +1,222 @@
+/** \file
+ * HSK Cooperative Scheduler implementation
+ *
+ * The scheduler keeps a 16 bit tick counter, the time at which each
+ * periodic task is due next is compared to it. A task is due when
+ * the difference is less than half the counter range.
+ *
+ * A periodic task that is delayed by a full period or more counts an
+ * overrun and is rescheduled relative to the current time, instead of
+ * being run repeatedly to catch up.
+ *
+ * @author kami
+ */
+
+#include <Infineon/XC878.h>
+
+#include "hsk_sched.h"
+
+#include "../hsk_wdt/hsk_wdt.h"
+
+/*
+ * SDCC does not like the code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/**
+ * Used to mark that no task was selected.
+ */
+#define SCHED_NONE      0xff
+
+/**
+ * Checks whether a point in time has been reached.
+ *
+ * @param now
+ *	The current time
+ * @param time
+ *	The time to check
+ */
+#define SCHED_REACHED(now, time)    ((uword)((now) - (time)) < 0x8000)
+
+/** \var sched
+ * The scheduler state.
+ */
+static struct {
+	/**
+	 * The task table.
+	 */
+	const hsk_sched_task code * tasks;
+
+	/**
+	 * The time each task is due next.
+	 */
+	uword next[SCHED_TASKS];
+
+	/**
+	 * The overrun counters of the tasks.
+	 */
+	ubyte overruns[SCHED_TASKS];
+
+	/**
+	 * The number of tasks.
+	 */
+	ubyte count;
+
+	/**
+	 * The next idle task to run.
+	 */
+	ubyte idle;
+
+	/**
+	 * The number of ticks between watchdog services.
+	 */
+	uword wdtPeriod;
+
+	/**
+	 * The time of the last watchdog service.
+	 */
+	uword wdtLast;
+} xdata sched;
+
+/**
+ * The scheduler time in ticks.
+ */
+static volatile uword pdata ticks;
+
+/**
+ * The signalled events.
+ */
+static volatile ubyte pdata signalled;
+
+void hsk_sched_init(const hsk_sched_task code * const tasks,
+                    const ubyte count, const uword wdtPeriod) {
+	ubyte i;
+
+	sched.tasks = tasks;
+	sched.count = count > SCHED_TASKS ? SCHED_TASKS : count;
+	sched.idle = 0;
+	sched.wdtPeriod = wdtPeriod;
+	sched.wdtLast = ticks;
+	for (i = 0; i < sched.count; i++) {
+		sched.next[i] = ticks + tasks[i].period;
+		sched.overruns[i] = 0;
+	}
+}
+
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+void hsk_sched_isr_tick(void) using 1 {
+	ticks++;
+}
+
+void hsk_sched_isr_signal(const ubyte events) using 1 {
+	signalled |= events;
+}
+#pragma restore
+
+void hsk_sched_signal(const ubyte events) {
+	bool ea = EA;
+	EA = 0;
+	signalled |= events;
+	EA = ea;
+}
+
+bool hsk_sched_step(void) {
+	uword time;
+	ubyte pending;
+	ubyte selected = SCHED_NONE;
+	bool late = 0;
+	bool ea;
+	ubyte i;
+
+	/* Get a consistent copy of the ISR data. */
+	ea = EA;
+	EA = 0;
+	time = ticks;
+	pending = signalled;
+	EA = ea;
+
+	/*
+	 * Select the highest priority ready task and check deadlines.
+	 */
+	for (i = 0; i < sched.count; i++) {
+		#define task    sched.tasks[i]
+		if (task.period && SCHED_REACHED(time, sched.next[i])) {
+			if (task.deadline && (uword)(time - sched.next[i]) > task.deadline) {
+				late = 1;
+			}
+			if (selected == SCHED_NONE) {
+				selected = i;
+			}
+		} else if ((task.events & pending) && selected == SCHED_NONE) {
+			selected = i;
+		}
+		#undef task
+	}
+
+	/* Service the watchdog unless a task is late. */
+	if (sched.wdtPeriod && !late
+	    && (uword)(time - sched.wdtLast) >= sched.wdtPeriod) {
+		sched.wdtLast = time;
+		hsk_wdt_service();
+	}
+
+	/* Select the next idle task. */
+	for (i = 0; selected == SCHED_NONE && i < sched.count; i++) {
+		#define task    sched.tasks[sched.idle]
+		if (!task.period && !task.events) {
+			selected = sched.idle;
+		}
+		#undef task
+		sched.idle = (sched.idle + 1) % sched.count;
+	}
+	if (selected == SCHED_NONE) {
+		return 0;
+	}
+
+	#define task    sched.tasks[selected]
+	/* Reschedule periodic tasks. */
+	if (task.period && SCHED_REACHED(time, sched.next[selected])) {
+		if ((uword)(time - sched.next[selected]) >= task.period) {
+			if (sched.overruns[selected] < 0xff) {
+				sched.overruns[selected]++;
+			}
+			sched.next[selected] = time + task.period;
+		} else {
+			sched.next[selected] += task.period;
+		}
+	}
+	/* Consume the events of the task. */
+	if (task.events) {
+		ea = EA;
+		EA = 0;
+		signalled &= ~task.events;
+		EA = ea;
+	}
+	task.run();
+	#undef task
+	return 1;
+}
+
+void hsk_sched_run(void) {
+	while (1) {
+		hsk_sched_step();
+	}
+}
+
+ubyte hsk_sched_overruns(const ubyte task) {
+	return sched.overruns[task];
+}
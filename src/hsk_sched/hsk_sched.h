@@ -0,0 +1,175 @@
+/** \file
+ * HSK Cooperative Scheduler headers
+ *
+ * Provides a run-to-completion scheduler for the main loop.
+ *
+ * Tasks are defined in a static table, the position in the table is
+ * the priority of a task, i.e. the first task has the highest priority.
+ * A task is run when its period has passed or when one of its events has
+ * been signalled, e.g. by an ISR callback. Tasks without a period and
+ * events are idle tasks, they share the time when no other task is ready.
+ *
+ * The scheduler also services the watchdog. If a task with a deadline is
+ * delayed beyond its deadline, the watchdog is no longer serviced, so a
+ * permanently overloaded system is reset by the watchdog.
+ *
+ * The scheduler time is advanced by hsk_sched_isr_tick(), which has to
+ * be called back by a timer, e.g. hsk_timer0_setup() or a
+ * periodic hsk_wheel_isr_create() timer. Pass its address directly, so
+ * the overlays.awk script adds it to the call tree of the ISR:
+ * \code
+ * hsk_wheel_isr_create(&hsk_sched_isr_tick);
+ * \endcode
+ * Otherwise the following C51 overlay directive has to be added
+ * manually:
+ * \code
+ * hsk_wheel_isr_tick ! (hsk_sched_isr_tick)
+ * \endcode
+ *
+ * @author kami
+ */
+
+#ifndef _HSK_SCHED_H_
+#define _HSK_SCHED_H_
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/*
+ * SDCC does not like the \c code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/**
+ * The maximum number of tasks.
+ */
+#define SCHED_TASKS     16
+
+/**
+ * Returns the event flag for an event number.
+ *
+ * @param event
+ *	The event number in the range [0; 7]
+ */
+#define SCHED_EVENT(event)    (1 << (event))
+
+/**
+ * A task definition.
+ */
+typedef struct {
+	/**
+	 * The task function.
+	 */
+	void (code *run)(void);
+
+	/**
+	 * The number of ticks between runs, 0 for tasks without a period.
+	 */
+	uword period;
+
+	/**
+	 * The number of ticks a periodic task may be delayed, before the
+	 * watchdog is no longer serviced, 0 for unsupervised tasks.
+	 */
+	uword deadline;
+
+	/**
+	 * The event flags that trigger the task.
+	 */
+	ubyte events;
+} hsk_sched_task;
+
+/**
+ * Sets up the scheduler.
+ *
+ * @param tasks
+ *	The task table, ordered by priority
+ * @param count
+ *	The number of tasks, up to SCHED_TASKS
+ * @param wdtPeriod
+ *	The number of ticks between calls of hsk_wdt_service(), 0 if the
+ *	scheduler should not service the watchdog
+ */
+void hsk_sched_init(const hsk_sched_task code * const tasks,
+                    const ubyte count, const uword wdtPeriod);
+
+/**
+ * Advances the scheduler time by one tick.
+ *
+ * Use this as a timer callback.
+ */
+void hsk_sched_isr_tick(void) using(1);
+
+/**
+ * Signals events from an ISR callback.
+ *
+ * @param events
+ *	The event flags to set
+ */
+void hsk_sched_isr_signal(const ubyte events) using(1);
+
+/**
+ * Signals events from regular code.
+ *
+ * @param events
+ *	The event flags to set
+ */
+void hsk_sched_signal(const ubyte events);
+
+/**
+ * Runs the most urgent ready task.
+ *
+ * Periodic tasks and event triggered tasks are preferred by priority,
+ * if none of them is ready the next idle task is run.
+ *
+ * This also services the watchdog, unless a supervised task is beyond
+ * its deadline.
+ *
+ * @retval 1
+ *	A task was run
+ * @retval 0
+ *	No task was ready
+ */
+bool hsk_sched_step(void);
+
+/**
+ * Runs the scheduler forever.
+ */
+void hsk_sched_run(void);
+
+/**
+ * Returns the number of times a periodic task missed a period.
+ *
+ * The counter saturates at 255.
+ *
+ * @param task
+ *	The index of the task in the task table
+ * @return
+ *	The number of overruns
+ */
+ubyte hsk_sched_overruns(const ubyte task);
+
+/*
+ * Restore the usual meaning of \c code.
+ */
+#ifdef SDCC
+	#undef code
+	#define code	__code
+#endif
+
+/*
+ * Restore the usual meaning of \c using(bank).
+ */
+#ifdef __C51__
+	#undef using
+#endif /* __C51__ */
+
+#endif /* _HSK_SCHED_H_ */
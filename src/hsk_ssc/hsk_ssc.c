@@ -12,6 +12,22 @@
 
 #include "hsk_ssc.h"
 
+/*
+ * SDCC does not like the code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
 /** \var bufState
  * Keeps the SSC communication state.
  */
@@ -37,6 +53,61 @@ static struct {
 	ubyte wcount;
 } pdata bufState;
 
+/** \var queue
+ * The queue of buffers for streaming transfers.
+ *
+ * Entries from rpos to tail are in use, entries from wpos on have not
+ * been started yet. Writing runs one byte ahead of reading, so wpos
+ * moves to the next buffer before rpos does.
+ */
+static struct {
+	/**
+	 * The queued buffers.
+	 */
+	char xdata * buffers[SSC_QUEUE_SIZE];
+
+	/**
+	 * The lengths of the queued buffers.
+	 */
+	ubyte lens[SSC_QUEUE_SIZE];
+
+	/**
+	 * The entry currently being read into.
+	 */
+	ubyte rpos;
+
+	/**
+	 * The next entry to start writing.
+	 */
+	ubyte wpos;
+
+	/**
+	 * The next free entry.
+	 */
+	volatile ubyte tail;
+
+	/**
+	 * The completion callback.
+	 */
+	void (code *callback)(char xdata * buffer) using(1);
+} pdata queue;
+
+/**
+ * Starts transfer of the queue entry wpos, which has to be the entry
+ * rpos.
+ *
+ * Only use this when no transfer is in progress and the entry is
+ * available.
+ */
+#define SSC_START() { \
+	bufState.rptr = queue.buffers[queue.rpos]; \
+	bufState.rcount = queue.lens[queue.rpos]; \
+	bufState.wptr = bufState.rptr + 1; \
+	bufState.wcount = bufState.rcount - 1; \
+	queue.wpos = (queue.wpos + 1) & (SSC_QUEUE_SIZE - 1); \
+	SSC_TBL = *bufState.rptr; \
+}
+
 /**
  * SYSCON0 Special Function Register Map Control bit.
  */
@@ -59,9 +130,13 @@ static struct {
 
 /**
  * Transmit and receive interrupt.
+ *
+ * Queued transfers are chained, the first byte of the next buffer is
+ * written as soon as the transmit buffer is free.
  */
 void ISR_hsk_ssc(void) interrupt 7 using 1 {
 	bool rmap = (SYSCON0 >> BIT_RMAP) & 1;
+	char xdata * done;
 	RESET_RMAP();
  	SFR_PAGE(_su0, SST0);
 
@@ -69,11 +144,33 @@ void ISR_hsk_ssc(void) interrupt 7 using 1 {
 		IRCON1 &= ~(1 << BIT_RIR);
 		if (bufState.rcount) {
 			*(bufState.rptr++) = SSC_RBL;
-			bufState.rcount--;
+			if (!--bufState.rcount && queue.rpos != queue.tail) {
+				/* A queued buffer is complete. */
+				done = queue.buffers[queue.rpos];
+				queue.rpos = (queue.rpos + 1) & (SSC_QUEUE_SIZE - 1);
+				if (queue.rpos != queue.wpos) {
+					/* Writing already continued. */
+					bufState.rptr = queue.buffers[queue.rpos];
+					bufState.rcount = queue.lens[queue.rpos];
+				} else if (queue.rpos != queue.tail) {
+					/* Queued too late to chain on write. */
+					SSC_START();
+				}
+				if (queue.callback) {
+					queue.callback(done);
+				}
+			}
 		}
 	}
 	if ((IRCON1 >> BIT_TIR) & 1) {
 		IRCON1 &= ~(1 << BIT_TIR);
+		if (!bufState.wcount && bufState.rcount \
+		    && queue.wpos != queue.tail) {
+			/* Chain into the next queued buffer. */
+			bufState.wptr = queue.buffers[queue.wpos];
+			bufState.wcount = queue.lens[queue.wpos];
+			queue.wpos = (queue.wpos + 1) & (SSC_QUEUE_SIZE - 1);
+		}
 		if (bufState.wcount) {
 			SSC_TBL = *(bufState.wptr++);
 			bufState.wcount--;
@@ -269,6 +366,38 @@ void hsk_ssc_talk(char xdata * buffer, ubyte len) {
 	SSC_TBL = *buffer;
 }
 
+ubyte hsk_ssc_queue(char xdata * const buffer, const ubyte len) {
+	ubyte tail = (queue.tail + 1) & (SSC_QUEUE_SIZE - 1);
+	bool essc = ESSC;
+
+	if (!len || tail == queue.rpos) {
+		return SSC_ERROR;
+	}
+
+	/* Keep the ISR out while the queue is modified. */
+	ESSC = 0;
+	queue.buffers[queue.tail] = buffer;
+	queue.lens[queue.tail] = len;
+	queue.tail = tail;
+	if (!bufState.rcount) {
+		/* The SSC is idle, start the transfer. */
+		IRCON1 &= ~(1 << BIT_TIR) & ~(1 << BIT_RIR);
+		SSC_START();
+		essc = 1;
+	}
+	ESSC = essc;
+	return 0;
+}
+
+ubyte hsk_ssc_queued(void) {
+	return (queue.tail - queue.rpos) & (SSC_QUEUE_SIZE - 1);
+}
+
+void hsk_ssc_setCallback(const void (code * const __xdata callback)
+                                    (char xdata * buffer) using(1)) {
+	queue.callback = callback;
+}
+
 /**
  * SSC_CONH_O Enable Bit.
  */
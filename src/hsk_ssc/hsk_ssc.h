@@ -38,6 +38,40 @@
  * SSC_TX();
  * hsk_ssc_talk(buffer, sizeof(buffer) - 1);
  * \endcode
+ *
+ * \section streaming Streaming
+ *
+ * Calling hsk_ssc_talk() for every buffer leaves a gap on the wire
+ * between two buffers. Instead up to \ref SSC_QUEUE_SIZE - 1 buffers can
+ * be queued with hsk_ssc_queue(). The ISR writes the first byte of the
+ * next buffer as soon as the last byte of the previous buffer was moved
+ * to the shift register, so the SSC is kept busy at full baud rate.
+ *
+ * An optional callback is called by the ISR after every completed
+ * buffer:
+ * \code
+ * char xdata * pdata sscDoneBuf = 0;
+ *
+ * #pragma save
+ * #ifdef SDCC
+ * #pragma nooverlay
+ * #endif
+ * void sscDone(char xdata * buffer) using 1 {
+ * 	sscDoneBuf = buffer;
+ * }
+ * #pragma restore
+ *
+ * ...
+ * hsk_ssc_setCallback(&sscDone);
+ * hsk_ssc_queue(frame0, sizeof(frame0));
+ * hsk_ssc_queue(frame1, sizeof(frame1));
+ * ...
+ * if (hsk_ssc_queued() < SSC_QUEUE_SIZE - 1) {
+ * 	// Refill and queue the next frame
+ * }
+ * \endcode
+ *
+ * Do not mix hsk_ssc_talk() with queued transfers.
  */
 
 #ifndef _HSK_SSC_H_
@@ -50,6 +84,32 @@
 #include "hsk_ssc.isr"
 #endif /* SDCC */
 
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/*
+ * SDCC does not like the \c code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/**
+ * Value returned by functions in case of an error.
+ */
+#define SSC_ERROR         0xff
+
+/**
+ * The number of entries in the transfer queue, has to be a power of 2.
+ */
+#define SSC_QUEUE_SIZE    4
+
 /**
  * \defgroup SSC_PORTS	SSC I/O Ports
  *
@@ -228,6 +288,46 @@ void hsk_ssc_talk(char xdata * buffer, ubyte len);
  */
 #define hsk_ssc_busy()    ESSC
 
+/**
+ * Queue a buffer for transmission.
+ *
+ * The transfer starts immediately if the SSC is idle, otherwise it
+ * follows the previously queued buffers without a gap.
+ *
+ * The buffer must not be touched until the transfer is completed.
+ *
+ * @param buffer
+ *	The rx/tx transmission buffer
+ * @param len
+ *	The length of the buffer, must not be 0
+ * @retval SSC_ERROR
+ *	The queue is full or the buffer is empty
+ * @retval 0
+ *	The buffer was queued
+ */
+ubyte hsk_ssc_queue(char xdata * const buffer, const ubyte len);
+
+/**
+ * Returns the number of queued buffers, including the one in transfer.
+ *
+ * @return
+ *	The number of incomplete buffers
+ */
+ubyte hsk_ssc_queued(void);
+
+/**
+ * Set a callback for completed queued buffers.
+ *
+ * The callback is called by the ISR and receives the completed buffer.
+ * Note that the callback function is entered with the current SFR page
+ * unknown.
+ *
+ * @param callback
+ *	A function pointer to a callback function, 0 for no callback
+ */
+void hsk_ssc_setCallback(const void (code * const __xdata callback)
+                                    (char xdata * buffer) using(1));
+
 /**
  * Turn the SSC module on.
  */
@@ -238,4 +338,19 @@ void hsk_ssc_enable();
  */
 void hsk_ssc_disable();
 
+/*
+ * Restore the usual meaning of \c code.
+ */
+#ifdef SDCC
+	#undef code
+	#define code	__code
+#endif
+
+/*
+ * Restore the usual meaning of \c using(bank).
+ */
+#ifdef __C51__
+	#undef using
+#endif /* __C51__ */
+
 #endif /* _HSK_SSC_H_ */
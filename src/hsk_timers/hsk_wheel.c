@@ -0,0 +1,369 @@
+/** \file
+ * HSK Timer Wheel implementation
+ *
+ * The timers of each wheel slot are kept in a doubly linked list, so
+ * timers can be inserted and removed in constant time. Timers with delays
+ * beyond the wheel size carry a rounds counter, which is decremented each
+ * time the wheel passes their slot.
+ *
+ * Timers dispatched by hsk_wheel_run() are queued in a ring buffer. Every
+ * timer is queued at most once, so the queue cannot overflow.
+ *
+ * The list manipulation functions are implemented as macros, because they
+ * are used in the ISR and in regular code, which use different register
+ * banks.
+ *
+ * @author kami
+ */
+
+#include <Infineon/XC878.h>
+
+#include "hsk_wheel.h"
+
+#include "hsk_timer01.h"
+
+/*
+ * SDCC does not like the code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/**
+ * Marks the end of a list.
+ */
+#define WHEEL_NONE      0xff
+
+/**
+ * The size of the dispatch queue, has to be a power of 2 greater than
+ * WHEEL_TIMERS.
+ */
+#define WHEEL_QUEUE     32
+
+/**
+ * Timer flag, set for allocated timers.
+ */
+#define FLAG_USED       0x01
+
+/**
+ * Timer flag, set for timers dispatched by the ISR.
+ */
+#define FLAG_ISR        0x02
+
+/**
+ * Timer flag, set for timers linked into the wheel.
+ */
+#define FLAG_ACTIVE     0x04
+
+/** \var timers
+ * The software timers.
+ */
+static volatile struct {
+	/**
+	 * The callback function for timers dispatched by the ISR.
+	 */
+	void (code *isr)(void) using(1);
+
+	/**
+	 * The callback function for timers dispatched by hsk_wheel_run().
+	 */
+	void (code *callback)(void);
+
+	/**
+	 * The number of wheel rounds left before the timer expires.
+	 */
+	uword rounds;
+
+	/**
+	 * The timer period, 0 for one-shot timers.
+	 */
+	uword period;
+
+	/**
+	 * The next timer in the slot list.
+	 */
+	ubyte next;
+
+	/**
+	 * The previous timer in the slot list.
+	 */
+	ubyte prev;
+
+	/**
+	 * The next timer expired in the same tick.
+	 */
+	ubyte chain;
+
+	/**
+	 * The wheel slot the timer is linked into.
+	 */
+	ubyte slot;
+
+	/**
+	 * The FLAG_* bits of the timer.
+	 */
+	ubyte flags;
+
+	/**
+	 * Set while the timer is in the dispatch queue.
+	 */
+	ubyte queued;
+
+	/**
+	 * Set if a queued dispatch was cancelled.
+	 */
+	ubyte cancelled;
+} xdata timers[WHEEL_TIMERS];
+
+/** \var wheel
+ * The timer wheel.
+ */
+static volatile struct {
+	/**
+	 * The first timer of every slot.
+	 */
+	ubyte slots[WHEEL_SLOTS];
+
+	/**
+	 * The dispatch queue for hsk_wheel_run().
+	 */
+	ubyte queue[WHEEL_QUEUE];
+
+	/**
+	 * The current wheel slot.
+	 */
+	ubyte now;
+
+	/**
+	 * The dispatch queue read position.
+	 */
+	ubyte rpos;
+
+	/**
+	 * The dispatch queue write position.
+	 */
+	ubyte wpos;
+} xdata wheel;
+
+/**
+ * Removes a timer from its wheel slot.
+ *
+ * @param timer
+ *	The timer to remove
+ * @private
+ */
+#define WHEEL_UNLINK(timer) { \
+	if (timers[timer].prev == WHEEL_NONE) { \
+		wheel.slots[timers[timer].slot] = timers[timer].next; \
+	} else { \
+		timers[timers[timer].prev].next = timers[timer].next; \
+	} \
+	if (timers[timer].next != WHEEL_NONE) { \
+		timers[timers[timer].next].prev = timers[timer].prev; \
+	} \
+	timers[timer].flags &= ~FLAG_ACTIVE; \
+}
+
+/**
+ * Inserts a timer into the wheel.
+ *
+ * @param timer
+ *	The timer to insert
+ * @param delay
+ *	The number of ticks until the timer expires, must not be 0
+ * @private
+ */
+#define WHEEL_LINK(timer, delay) { \
+	timers[timer].slot = (wheel.now + (delay)) & (WHEEL_SLOTS - 1); \
+	timers[timer].rounds = ((delay) - 1) / WHEEL_SLOTS; \
+	timers[timer].prev = WHEEL_NONE; \
+	timers[timer].next = wheel.slots[timers[timer].slot]; \
+	if (timers[timer].next != WHEEL_NONE) { \
+		timers[timers[timer].next].prev = timer; \
+	} \
+	wheel.slots[timers[timer].slot] = timer; \
+	timers[timer].flags |= FLAG_ACTIVE; \
+}
+
+#pragma save
+#ifdef SDCC
+#pragma nooverlay
+#endif
+/**
+ * Advances the wheel by one slot and dispatches expired timers.
+ *
+ * This is called back by the timer 0 ISR.
+ *
+ * Expired timers are collected before dispatching, so callbacks cannot
+ * disturb the traversal of the slot list.
+ *
+ * @private
+ */
+void hsk_wheel_isr_tick(void) using 1 {
+	ubyte timer, next;
+	ubyte expired = WHEEL_NONE;
+
+	wheel.now = (wheel.now + 1) & (WHEEL_SLOTS - 1);
+
+	/* Collect expired timers and rearm periodic timers. */
+	for (timer = wheel.slots[wheel.now]; timer != WHEEL_NONE; timer = next) {
+		next = timers[timer].next;
+		if (timers[timer].rounds) {
+			timers[timer].rounds--;
+		} else {
+			WHEEL_UNLINK(timer);
+			if (timers[timer].period) {
+				WHEEL_LINK(timer, timers[timer].period);
+			}
+			timers[timer].chain = expired;
+			expired = timer;
+		}
+	}
+
+	/* Dispatch expired timers. */
+	for (timer = expired; timer != WHEEL_NONE; timer = timers[timer].chain) {
+		if (timers[timer].flags & FLAG_ISR) {
+			timers[timer].isr();
+		} else if (!timers[timer].queued) {
+			timers[timer].queued = 1;
+			wheel.queue[wheel.wpos] = timer;
+			wheel.wpos = (wheel.wpos + 1) & (WHEEL_QUEUE - 1);
+		} else {
+			/* Revive a cancelled dispatch. */
+			timers[timer].cancelled = 0;
+		}
+	}
+}
+#pragma restore
+
+void hsk_wheel_init(const uword interval) {
+	ubyte i;
+	bool et0 = ET0;
+	ET0 = 0;
+
+	for (i = 0; i < WHEEL_SLOTS; i++) {
+		wheel.slots[i] = WHEEL_NONE;
+	}
+	wheel.now = 0;
+	wheel.rpos = 0;
+	wheel.wpos = 0;
+	for (i = 0; i < WHEEL_TIMERS; i++) {
+		timers[i].flags = 0;
+		timers[i].queued = 0;
+		timers[i].cancelled = 0;
+	}
+	hsk_timer0_setup(interval, &hsk_wheel_isr_tick);
+
+	ET0 = et0;
+}
+
+/**
+ * Allocates a free timer.
+ *
+ * Timers that still have a dispatch queued are not reused.
+ *
+ * @param flags
+ *	The initial flags of the timer
+ * @return
+ *	A free timer or WHEEL_ERROR
+ * @private
+ */
+hsk_wheel_timer hsk_wheel_alloc(const ubyte flags) {
+	hsk_wheel_timer timer;
+
+	for (timer = 0; timer < WHEEL_TIMERS; timer++) {
+		if (!timers[timer].flags && !timers[timer].queued) {
+			timers[timer].cancelled = 0;
+			timers[timer].flags = FLAG_USED | flags;
+			return timer;
+		}
+	}
+	return WHEEL_ERROR;
+}
+
+hsk_wheel_timer hsk_wheel_isr_create(const void (code * const __xdata callback)
+                                                (void) using(1)) {
+	hsk_wheel_timer timer = hsk_wheel_alloc(FLAG_ISR);
+
+	if (timer != WHEEL_ERROR) {
+		timers[timer].isr = callback;
+	}
+	return timer;
+}
+
+hsk_wheel_timer hsk_wheel_create(const void (code * const __xdata callback)
+                                            (void)) {
+	hsk_wheel_timer timer = hsk_wheel_alloc(0);
+
+	if (timer != WHEEL_ERROR) {
+		timers[timer].callback = callback;
+	}
+	return timer;
+}
+
+void hsk_wheel_delete(const hsk_wheel_timer timer) {
+	hsk_wheel_cancel(timer);
+	timers[timer].flags = 0;
+}
+
+void hsk_wheel_start(const hsk_wheel_timer timer, const uword delay,
+                     const uword period) {
+	bool et0 = ET0;
+	ET0 = 0;
+
+	if (timers[timer].flags & FLAG_ACTIVE) {
+		WHEEL_UNLINK(timer);
+	}
+	timers[timer].period = period;
+	WHEEL_LINK(timer, delay ? delay : 1);
+
+	ET0 = et0;
+}
+
+void hsk_wheel_cancel(const hsk_wheel_timer timer) {
+	bool et0 = ET0;
+	ET0 = 0;
+
+	if (timers[timer].flags & FLAG_ACTIVE) {
+		WHEEL_UNLINK(timer);
+	}
+	if (timers[timer].queued) {
+		timers[timer].cancelled = 1;
+	}
+
+	ET0 = et0;
+}
+
+bool hsk_wheel_active(const hsk_wheel_timer timer) {
+	return (timers[timer].flags & FLAG_ACTIVE) != 0;
+}
+
+void hsk_wheel_run(void) {
+	hsk_wheel_timer timer;
+	bool dispatch;
+	bool et0;
+
+	while (wheel.rpos != wheel.wpos) {
+		et0 = ET0;
+		ET0 = 0;
+		timer = wheel.queue[wheel.rpos];
+		wheel.rpos = (wheel.rpos + 1) & (WHEEL_QUEUE - 1);
+		dispatch = !timers[timer].cancelled;
+		timers[timer].queued = 0;
+		timers[timer].cancelled = 0;
+		ET0 = et0;
+
+		if (dispatch) {
+			timers[timer].callback();
+		}
+	}
+}
@@ -0,0 +1,165 @@
+/** \file
+ * HSK Timer Wheel headers
+ *
+ * Provides a large number of one-shot and periodic software timers on top
+ * of timer 0.
+ *
+ * The timers are kept in a hashed timer wheel, starting and cancelling a
+ * timer takes constant time, a tick only visits the timers hashed into
+ * a single wheel slot.
+ *
+ * Expired timers are either dispatched by the timer 0 ISR or they are queued
+ * and dispatched by calling hsk_wheel_run() from the main loop.
+ *
+ * @author kami
+ */
+
+#ifndef _HSK_WHEEL_H_
+#define _HSK_WHEEL_H_
+
+/*
+ * C51 does not include the used register bank in pointer types.
+ */
+#ifdef __C51__
+	#define using(bank)
+#endif
+
+/*
+ * SDCC does not like the \c code keyword for function pointers, C51 needs it
+ * or it will use generic pointers.
+ */
+#ifdef SDCC
+	#undef code
+	#define code
+#endif /* SDCC */
+
+/**
+ * The number of available software timers.
+ */
+#define WHEEL_TIMERS    16
+
+/**
+ * The number of wheel slots, has to be a power of 2.
+ *
+ * Timers with delays longer than this number of ticks have to survive
+ * several rounds of the wheel.
+ */
+#define WHEEL_SLOTS     16
+
+/**
+ * Returned by timer creation functions when no more timers are available.
+ */
+#define WHEEL_ERROR     0xff
+
+/**
+ * Software timer identifiers.
+ */
+typedef ubyte hsk_wheel_timer;
+
+/**
+ * Setup the timer wheel to tick at a given interval.
+ *
+ * This sets up timer 0, the wheel starts ticking after calling
+ * hsk_timer0_enable().
+ *
+ * @param interval
+ *	The ticking interval in µs, see hsk_timer0_setup()
+ */
+void hsk_wheel_init(const uword interval);
+
+/**
+ * Creates a software timer dispatched by the timer 0 ISR.
+ *
+ * The callback is run in ISR context, so it must not call the hsk_wheel
+ * functions. Use a periodic timer or hsk_wheel_create() instead.
+ *
+ * The overlays.awk script adds the callback to the call tree of
+ * hsk_wheel_isr_tick(), if its address is passed directly, e.g.
+ * hsk_wheel_isr_create(&callback).
+ *
+ * @param callback
+ *	The function to call back when the timer expires
+ * @return
+ *	A software timer identifier or WHEEL_ERROR
+ */
+hsk_wheel_timer hsk_wheel_isr_create(const void (code * const __xdata callback)
+                                                (void) using(1));
+
+/**
+ * Creates a software timer dispatched by hsk_wheel_run().
+ *
+ * @param callback
+ *	The function to call back when the timer expires
+ * @return
+ *	A software timer identifier or WHEEL_ERROR
+ */
+hsk_wheel_timer hsk_wheel_create(const void (code * const __xdata callback)
+                                            (void));
+
+/**
+ * Cancels and frees a software timer.
+ *
+ * @param timer
+ *	The timer to delete
+ */
+void hsk_wheel_delete(const hsk_wheel_timer timer);
+
+/**
+ * Starts or restarts a software timer.
+ *
+ * @param timer
+ *	The timer to start
+ * @param delay
+ *	The number of ticks until the timer expires, 0 is treated as 1
+ * @param period
+ *	The number of ticks between subsequent expiries of a periodic timer,
+ *	0 for a one-shot timer
+ */
+void hsk_wheel_start(const hsk_wheel_timer timer, const uword delay,
+                     const uword period);
+
+/**
+ * Cancels a software timer.
+ *
+ * A queued dispatch of the timer by hsk_wheel_run() is dropped.
+ *
+ * @param timer
+ *	The timer to cancel
+ */
+void hsk_wheel_cancel(const hsk_wheel_timer timer);
+
+/**
+ * Returns whether a software timer is running.
+ *
+ * @param timer
+ *	The timer to check
+ * @retval 1
+ *	The timer will expire
+ * @retval 0
+ *	The timer is stopped
+ */
+bool hsk_wheel_active(const hsk_wheel_timer timer);
+
+/**
+ * Dispatches the expired timers created with hsk_wheel_create().
+ *
+ * Call this from the main loop.
+ */
+void hsk_wheel_run(void);
+
+/*
+ * Restore the usual meaning of \c code.
+ */
+#ifdef SDCC
+	#undef code
+	#define code	__code
+#endif
+
+/*
+ * Restore the usual meaning of \c using(bank).
+ */
+#ifdef __C51__
+	#undef using
+#endif /* __C51__ */
+
+#endif /* _HSK_WHEEL_H_ */
@@ -20,6 +20,9 @@ eval "$(make printEnv)"
 echo "Generating C-headers from DBCs ..." 1>&2
 make dbc
 
+echo "Generating shared ISR configuration ..." 1>&2
+make isrconf
+
 echo "Preparing header include directories ..." 1>&2
 _GENDIR="$(echo "$GENDIR" | tr '/' '\\')"
 